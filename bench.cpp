@@ -0,0 +1,749 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_set>
+#include <new>
+#include <vector>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "concurrent_hash.hpp"
+#include "cow_hash.hpp"
+#include "filter_hash.hpp"
+#include "hash.hpp"
+#include "leftright_hash.hpp"
+#include "lockfree_hash.hpp"
+#include "roaring_set.hpp"
+#include "set_algebra.hpp"
+#include "small_hash.hpp"
+
+// Benchmarks for HashSet.  Build against Google Benchmark, e.g.
+//   g++ -std=c++20 -O2 bench.cpp -lbenchmark -pthread
+
+namespace {
+
+// every call to the global operator new, for the allocation-count benchmarks
+std::atomic<std::size_t> heapAllocations {0};
+
+std::vector<int> randomKeys(std::size_t n, unsigned seed) {
+  std::mt19937 mt {seed};
+  std::uniform_int_distribution<int> dist;
+  std::vector<int> keys(n);
+  std::generate(keys.begin(), keys.end(), [&mt, &dist](){return dist(mt);});
+  return keys;
+}
+
+// bytes the heap has handed out and not taken back, or 0 where that is
+// not known
+std::size_t heapInUse() {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+}  // namespace
+
+// kept out of line so that GCC does not pair the inlined malloc and free
+// against the operator new / delete they replace
+[[gnu::noinline]] void* operator new(std::size_t size) {
+  heapAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+// The scalar loop of the containsComplexity test: one dependent chain walk
+// per key.
+template <typename Set>
+void BM_ContainsScalar(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 13'884);
+  Set h;
+  for (int x : keys) {
+    h.insert(x);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937 {1});
+  for (auto _ : state) {
+    std::size_t hits = 0;
+    for (int x : keys) {
+      hits += h.contains(x);
+    }
+    benchmark::DoNotOptimize(hits);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Set>
+void BM_ContainsBatch(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 13'884);
+  Set h;
+  for (int x : keys) {
+    h.insert(x);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937 {1});
+  std::vector<std::uint64_t> mask((n + 63) / 64);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(h.containsBatch(keys, mask));
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Set>
+void BM_InsertScalar(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 82'323);
+  for (auto _ : state) {
+    Set h;
+    for (int x : keys) {
+      h.insert(x);
+    }
+    benchmark::DoNotOptimize(h.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// A stream of n keys in which every eighth key is new and the others are
+// already in the set.  Each duplicate costs a single walk of its chain.
+template <typename Set>
+void BM_InsertDuplicates(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> present = randomKeys(n / 8, 40'951);
+  std::vector<int> fresh = randomKeys(n / 8, 40'952);
+  std::vector<int> stream(n);
+  std::mt19937 mt {9};
+  for (std::size_t i = 0; i < n; ++i) {
+    stream[i] = (i % 8 == 7) ? fresh[i / 8] : present[mt() % present.size()];
+  }
+  Set full;
+  for (int x : present) {
+    full.insert(x);
+  }
+  for (auto _ : state) {
+    state.PauseTiming();
+    Set h = full;
+    state.ResumeTiming();
+    std::size_t added = 0;
+    for (int x : stream) {
+      added += h.insert(x).second;
+    }
+    benchmark::DoNotOptimize(added);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Set>
+void BM_InsertBatch(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 82'323);
+  for (auto _ : state) {
+    Set h;
+    h.insertBatch(keys);
+    benchmark::DoNotOptimize(h.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Building from a range picks the final bucket count once, where
+// BM_InsertScalar rehashes every time the table doubles.
+template <typename Set>
+void BM_InsertRange(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 82'323);
+  for (auto _ : state) {
+    Set h(keys.begin(), keys.end());
+    benchmark::DoNotOptimize(h.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Growing to tens or hundreds of millions of keys, past the end of the old
+// 2.9 million bucket sizes table, then probing hits and misses.  The load
+// factor shows whether growth kept up.  The peak resident size is that of the
+// whole process, so run one size at a time with --benchmark_filter; 100M keys
+// peak at about 1.7 GB with the flat backend and 5 GB with the chained one.
+template <typename Set>
+void BM_Stress(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 4'021);
+  std::vector<int> probes = randomKeys(1'000'000, 77);
+  std::size_t hits = 0;
+  for (auto _ : state) {
+    Set h;
+    for (int x : keys) {
+      h.insert(x);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int x : probes) {
+      hits += h.contains(x);
+    }
+    for (std::size_t i = 0; i < probes.size(); ++i) {
+      hits += h.contains(keys[i * (n / probes.size())]);
+    }
+    std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+    state.counters["load_factor"] = h.loadFactor();
+    state.counters["buckets"] = h.bucketCount();
+    state.counters["lookup_ns"] = took.count() / (2 * probes.size());
+  }
+  benchmark::DoNotOptimize(hits);
+  rusage usage {};
+  getrusage(RUSAGE_SELF, &usage);
+  state.counters["peak_rss_mb"] = usage.ru_maxrss / 1024.0;
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Service startup: rebuilding a set of n keys by inserting them all, against
+// mapping a snapshot of it (1 = checksum verified, 0 = trusted) and running
+// 10,000 lookups.  The snapshot is in the page cache, as after a restart on
+// the same machine; a cold cache adds the cost of reading the file.
+void BM_StartupRebuild(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 61'001);
+  for (auto _ : state) {
+    HashSet h;
+    for (int x : keys) {
+      h.insert(x);
+    }
+    benchmark::DoNotOptimize(h.size());
+  }
+}
+
+void BM_StartupMapped(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 61'001);
+  std::string path = "/tmp/hashset_bench_snapshot";
+  {
+    HashSet h(keys.begin(), keys.end());
+    h.save(path);
+  }
+  std::size_t hits = 0;
+  for (auto _ : state) {
+    auto mapped = HashSet::openMapped(path, state.range(1) != 0);
+    for (std::size_t i = 0; i < 10'000; ++i) {
+      hits += mapped.contains(keys[i * (n / 10'000)]);
+    }
+  }
+  benchmark::DoNotOptimize(hits);
+  std::remove(path.c_str());
+}
+
+// Two sets of n random keys, half of them shared, combined with the set
+// algebra (threads from the second argument) and with the loop
+// std::unordered_set needs for the same result.
+template <typename Set>
+void BM_Intersection(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n + n / 2, 5'417);
+  Set a(keys.begin(), keys.begin() + n);
+  Set b(keys.begin() + n / 2, keys.end());
+  for (auto _ : state) {
+    Set c = setIntersection(a, b, state.range(1));
+    benchmark::DoNotOptimize(c.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Set>
+void BM_Union(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n + n / 2, 5'417);
+  Set a(keys.begin(), keys.begin() + n);
+  Set b(keys.begin() + n / 2, keys.end());
+  for (auto _ : state) {
+    Set c = setUnion(a, b, state.range(1));
+    benchmark::DoNotOptimize(c.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_IntersectionStd(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n + n / 2, 5'417);
+  std::unordered_set<int> a(keys.begin(), keys.begin() + n);
+  std::unordered_set<int> b(keys.begin() + n / 2, keys.end());
+  for (auto _ : state) {
+    std::unordered_set<int> c;
+    for (int x : a) {
+      if (b.contains(x)) {
+        c.insert(x);
+      }
+    }
+    benchmark::DoNotOptimize(c.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+void BM_UnionStd(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n + n / 2, 5'417);
+  std::unordered_set<int> a(keys.begin(), keys.begin() + n);
+  std::unordered_set<int> b(keys.begin() + n / 2, keys.end());
+  for (auto _ : state) {
+    std::unordered_set<int> c {a};
+    c.insert(b.begin(), b.end());
+    benchmark::DoNotOptimize(c.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Interleaved probes pay off on long chains, so the table is run at a high
+// load factor.  The second argument is the number of probes in flight.
+void BM_ContainsInterleaved(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 13'884);
+  ChainedHashSet<int> h;
+  h.maxLoadFactor(4.0);
+  for (int x : keys) {
+    h.insert(x);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937 {1});
+  std::vector<std::uint64_t> mask((n + 63) / 64);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(h.containsInterleaved(keys, mask, state.range(1)));
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Cost of mapping a hash to a bucket, with the bucket count near the middle
+// of each policy's table.  The hashes are independent, so this measures
+// throughput of the index computation alone.
+template <typename Policy>
+void BM_BucketIndex(benchmark::State& state) {
+  Policy policy(Policy::sizes[Policy::sizes.size() / 2]);
+  std::vector<int> keys = randomKeys(4'096, 5);
+  std::size_t sum = 0;
+  for (auto _ : state) {
+    for (int x : keys) {
+      sum += policy.index(std::hash<int>()(x));
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Chain walks recompute bucket() for every node they visit, so the index
+// cost is paid several times per lookup at high load factors.
+template <typename Policy>
+void BM_ContainsPolicy(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 13'884);
+  ChainedHashSet<int, std::hash<int>, std::equal_to<int>, std::allocator<int>, Policy> h;
+  h.maxLoadFactor(4.0);
+  for (int x : keys) {
+    h.insert(x);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937 {1});
+  for (auto _ : state) {
+    std::size_t hits = 0;
+    for (int x : keys) {
+      hits += h.contains(x);
+    }
+    benchmark::DoNotOptimize(hits);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+using CachedBucketSet = ChainedHashSet<int, std::hash<int>, std::equal_to<int>, std::allocator<int>,
+                                       PrimeModPolicy, CachedBucketNodes>;
+
+// Lookups at the load factor given by the second argument, half of them for
+// keys that are missing and so walk their whole chain.  Every node passed is
+// a bucket() with KeyNodes and a compare with CachedBucketNodes.
+template <typename Set>
+void BM_ContainsLoaded(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(2 * n, 61'027);
+  Set h;
+  h.maxLoadFactor(static_cast<float>(state.range(1)));
+  for (std::size_t i = 0; i < n; ++i) {
+    h.insert(keys[i]);
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937 {3});
+  for (auto _ : state) {
+    std::size_t hits = 0;
+    for (int x : keys) {
+      hits += h.contains(x);
+    }
+    benchmark::DoNotOptimize(hits);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.counters["load"] = h.loadFactor();
+}
+
+// Lookups of which the second argument is the percentage of hits; the
+// misses are keys that were never inserted.  FilteredHashSet answers most
+// misses from its filter, and pays for the filter on every hit.
+template <typename Set>
+void BM_ContainsHitRatio(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  const std::size_t hits = n * state.range(1) / 100;
+  std::vector<int> keys = randomKeys(2 * n, 58'331);
+  Set h;
+  for (std::size_t i = 0; i < n; ++i) {
+    h.insert(keys[i]);
+  }
+  std::vector<int> lookups(keys.begin(), keys.begin() + hits);
+  lookups.insert(lookups.end(), keys.begin() + n, keys.begin() + n + (n - hits));
+  std::shuffle(lookups.begin(), lookups.end(), std::mt19937 {5});
+  for (auto _ : state) {
+    std::size_t found = 0;
+    for (int x : lookups) {
+      found += h.contains(x);
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations() * lookups.size());
+}
+
+// n ids counted up from a base, with every second-argument one left out (0
+// leaves none out), then looked up over twice their range, so that half the
+// lookups miss.  RoaringSet keeps the ids as runs when there are no holes
+// and as bitmaps otherwise; the heap counter is what the set holds per id.
+template <typename Set>
+void BM_ContainsDenseIds(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  const std::size_t hole = state.range(1);
+  constexpr int kBase = 1'000'000;
+  std::size_t heap = heapInUse();
+  Set h;
+  std::size_t added = 0;
+  for (std::size_t i = 0; added < n; ++i) {
+    if (hole == 0 || i % hole != 0) {
+      h.insert(kBase + static_cast<int>(i));
+      added++;
+    }
+  }
+  if constexpr (requires { h.optimize(); }) {
+    h.optimize();
+  }
+  state.counters["heap/key"] = static_cast<double>(std::max(heapInUse(), heap) - heap) / n;
+
+  std::vector<int> lookups(n);
+  std::mt19937 mt {17};
+  std::uniform_int_distribution<int> dist {kBase, kBase + static_cast<int>(2 * n)};
+  std::generate(lookups.begin(), lookups.end(), [&mt, &dist](){return dist(mt);});
+  for (auto _ : state) {
+    std::size_t hits = 0;
+    for (int x : lookups) {
+      hits += h.contains(x);
+    }
+    benchmark::DoNotOptimize(hits);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Short-lived sets: each one is built from the argument's number of keys,
+// queried for twice as many and destroyed.  SmallHashSet stays inline up to
+// eight keys and allocates nothing for them.
+template <typename Set>
+void BM_ShortLivedSets(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(2 * n, 4'409);
+  std::size_t allocs = 0;
+  std::size_t sets = 0;
+  for (auto _ : state) {
+    std::size_t before = heapAllocations.load(std::memory_order_relaxed);
+    Set h;
+    for (std::size_t i = 0; i < n; ++i) {
+      h.insert(keys[i]);
+    }
+    std::size_t hits = 0;
+    for (int x : keys) {
+      hits += h.contains(x);
+    }
+    benchmark::DoNotOptimize(hits);
+    allocs += heapAllocations.load(std::memory_order_relaxed) - before;
+    sets++;
+  }
+  state.counters["allocs/set"] = static_cast<double>(allocs) / sets;
+  state.SetItemsProcessed(sets);
+}
+
+using SmallChainedSet = SmallHashSet<ChainedHashSet<int>, 8>;
+using SmallFlatSet = SmallHashSet<FlatHashSet<int>, 8>;
+
+using PooledSet = ChainedHashSet<int, std::hash<int>, std::equal_to<int>, PoolAllocator<int>>;
+
+// Building a set from scratch and then churning it at a constant size.  The
+// heap counters show how many operator new calls each phase costs: one per
+// node with std::allocator, one per slab with PoolAllocator, and none once
+// the pool's free list recycles erased nodes.
+template <typename Set>
+void BM_InsertAllocations(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 82'323);
+  std::size_t allocs = 0;
+  for (auto _ : state) {
+    std::size_t before = heapAllocations.load(std::memory_order_relaxed);
+    Set h;
+    for (int x : keys) {
+      h.insert(x);
+    }
+    benchmark::DoNotOptimize(h.size());
+    allocs += heapAllocations.load(std::memory_order_relaxed) - before;
+  }
+  state.counters["allocs/insert"] = static_cast<double>(allocs) / (state.iterations() * n);
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Set>
+void BM_ChurnAllocations(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(2 * n, 6'113);
+  Set h;
+  for (std::size_t i = 0; i < n; ++i) {
+    h.insert(keys[i]);
+  }
+  std::size_t allocs = 0;
+  std::size_t ops = 0;
+  for (auto _ : state) {
+    std::size_t before = heapAllocations.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < n; ++i) {
+      h.erase(keys[i]);
+      h.insert(keys[n + i]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      h.erase(keys[n + i]);
+      h.insert(keys[i]);
+    }
+    allocs += heapAllocations.load(std::memory_order_relaxed) - before;
+    ops += 2 * n;
+  }
+  state.counters["allocs/op"] = static_cast<double>(allocs) / ops;
+  state.SetItemsProcessed(ops);
+}
+
+// Longest single insert while a set grows to n keys, with rehashing done all
+// at once (0) or spread over the following inserts (1).  Only the worst case
+// should differ much between the two.
+void BM_InsertWorstCase(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 82'323);
+  double worst = 0;
+  for (auto _ : state) {
+    ChainedHashSet<int> h;
+    h.incrementalRehash(state.range(1) != 0);
+    for (int x : keys) {
+      auto start = std::chrono::steady_clock::now();
+      h.insert(x);
+      std::chrono::duration<double, std::micro> took = std::chrono::steady_clock::now() - start;
+      worst = std::max(worst, took.count());
+    }
+    benchmark::DoNotOptimize(h.size());
+  }
+  state.counters["worst_us"] = worst;
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// Taking a snapshot of a populated set: a deep copy, or a copy-on-write clone
+// whose first write pays for the copy instead.
+template <typename Set>
+void BM_Copy(benchmark::State& state) {
+  const std::size_t n = state.range(0);
+  std::vector<int> keys = randomKeys(n, 82'323);
+  Set h;
+  for (int x : keys) {
+    h.insert(x);
+  }
+  for (auto _ : state) {
+    Set copy {h};
+    benchmark::DoNotOptimize(copy.size());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// What the ingest path did before ConcurrentHashSet: one set, one mutex.
+class GlobalLockSet {
+ private:
+  std::mutex lock;
+  ChainedHashSet<int> set;
+
+ public:
+  bool insert(int key) {
+    std::lock_guard guard {lock};
+    return set.insert(key).second;
+  }
+
+  bool contains(int key) {
+    std::lock_guard guard {lock};
+    return set.contains(key);
+  }
+
+  bool erase(int key) {
+    std::lock_guard guard {lock};
+    std::size_t before = set.size();
+    set.erase(key);
+    return set.size() != before;
+  }
+};
+
+// Threads share one set of about 2^19 keys drawn from 2^20.  The second
+// argument is the percentage of lookups; the other operations alternate
+// between insert and erase so the size stays put.  Setup runs on thread 0
+// before the loop, which starts on a barrier for all threads.
+template <typename Set>
+void BM_ConcurrentMix(benchmark::State& state) {
+  static std::unique_ptr<Set> shared;
+  if (state.thread_index() == 0) {
+    shared = std::make_unique<Set>();
+    for (int x : randomKeys(1 << 19, 29)) {
+      shared->insert(x & ((1 << 20) - 1));
+    }
+  }
+  const int readPercent = state.range(0);
+  std::mt19937 mt {static_cast<unsigned>(state.thread_index() + 1)};
+  std::size_t ops = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < 1'024; ++i) {
+      int key = mt() & ((1 << 20) - 1);
+      if (static_cast<int>(mt() % 100) < readPercent) {
+        benchmark::DoNotOptimize(shared->contains(key));
+      } else if (i % 2 == 0) {
+        benchmark::DoNotOptimize(shared->insert(key));
+      } else {
+        benchmark::DoNotOptimize(shared->erase(key));
+      }
+    }
+    ops += 1'024;
+  }
+  state.SetItemsProcessed(ops);
+  if (state.thread_index() == 0) {
+    shared.reset();
+  }
+}
+
+// The usual answer for read-mostly sets: many readers, one reader counter.
+class SharedLockSet {
+ private:
+  mutable std::shared_mutex lock;
+  ChainedHashSet<int> set;
+
+ public:
+  bool insert(int key) {
+    std::unique_lock guard {lock};
+    return set.insert(key).second;
+  }
+
+  bool contains(int key) const {
+    std::shared_lock guard {lock};
+    return set.contains(key);
+  }
+
+  bool erase(int key) {
+    std::unique_lock guard {lock};
+    std::size_t before = set.size();
+    set.erase(key);
+    return set.size() != before;
+  }
+};
+
+// Allowlist traffic: every thread looks up keys in a 64k-key set that stays
+// cache resident, and thread 0 also writes once every 1,000 operations.
+template <typename Set>
+void BM_ReadMostly(benchmark::State& state) {
+  static std::unique_ptr<Set> shared;
+  if (state.thread_index() == 0) {
+    shared = std::make_unique<Set>();
+    for (int x = 0; x < (1 << 16); ++x) {
+      shared->insert(x);
+    }
+  }
+  std::mt19937 mt {static_cast<unsigned>(state.thread_index() + 1)};
+  std::size_t ops = 0;
+  for (auto _ : state) {
+    for (int i = 0; i < 1'000; ++i) {
+      benchmark::DoNotOptimize(shared->contains(mt() & ((1 << 17) - 1)));
+    }
+    if (state.thread_index() == 0) {
+      int key = mt() & ((1 << 16) - 1);
+      shared->erase(key);
+      shared->insert(key);
+    }
+    ops += 1'000;
+  }
+  state.SetItemsProcessed(ops);
+  if (state.thread_index() == 0) {
+    shared.reset();
+  }
+}
+
+BENCHMARK(BM_BucketIndex<PrimeModPolicy>);
+BENCHMARK(BM_BucketIndex<PrimeFastModPolicy>);
+BENCHMARK(BM_BucketIndex<Pow2MixPolicy>);
+BENCHMARK(BM_ContainsPolicy<PrimeModPolicy>)->Arg(10'000)->Arg(1'000'000);
+BENCHMARK(BM_ContainsPolicy<PrimeFastModPolicy>)->Arg(10'000)->Arg(1'000'000);
+BENCHMARK(BM_ContainsPolicy<Pow2MixPolicy>)->Arg(10'000)->Arg(1'000'000);
+BENCHMARK(BM_ContainsLoaded<ChainedHashSet<int>>)->ArgsProduct({{10'000, 1'000'000}, {1, 4, 8}});
+BENCHMARK(BM_ContainsLoaded<CachedBucketSet>)->ArgsProduct({{10'000, 1'000'000}, {1, 4, 8}});
+
+BENCHMARK(BM_ContainsScalar<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_ContainsBatch<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_ContainsScalar<FlatHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_ContainsBatch<FlatHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_ContainsHitRatio<ChainedHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {0, 10, 50, 90, 100}});
+BENCHMARK(BM_ContainsHitRatio<FilteredHashSet<ChainedHashSet<int>>>)->ArgsProduct({{100'000, 1'000'000}, {0, 10, 50, 90, 100}});
+BENCHMARK(BM_ContainsHitRatio<FlatHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {0, 10, 50, 90, 100}});
+BENCHMARK(BM_ContainsHitRatio<FilteredHashSet<FlatHashSet<int>>>)->ArgsProduct({{100'000, 1'000'000}, {0, 10, 50, 90, 100}});
+BENCHMARK(BM_ContainsDenseIds<ChainedHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {0, 16}});
+BENCHMARK(BM_ContainsDenseIds<FlatHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {0, 16}});
+BENCHMARK(BM_ContainsDenseIds<RoaringSet<>>)->ArgsProduct({{100'000, 1'000'000}, {0, 16}});
+BENCHMARK(BM_ShortLivedSets<ChainedHashSet<int>>)->Arg(2)->Arg(8)->Arg(32);
+BENCHMARK(BM_ShortLivedSets<FlatHashSet<int>>)->Arg(2)->Arg(8)->Arg(32);
+BENCHMARK(BM_ShortLivedSets<SmallChainedSet>)->Arg(2)->Arg(8)->Arg(32);
+BENCHMARK(BM_ShortLivedSets<SmallFlatSet>)->Arg(2)->Arg(8)->Arg(32);
+BENCHMARK(BM_ContainsInterleaved)->ArgsProduct({{100'000, 1'000'000}, {1, 4, 8, 16, 32}});
+BENCHMARK(BM_InsertScalar<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertBatch<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertRange<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertDuplicates<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertScalar<FlatHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertBatch<FlatHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertRange<FlatHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertDuplicates<FlatHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+
+BENCHMARK(BM_InsertAllocations<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertAllocations<PooledSet>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_ChurnAllocations<ChainedHashSet<int>>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_ChurnAllocations<PooledSet>)->RangeMultiplier(10)->Range(10'000, 1'000'000);
+BENCHMARK(BM_InsertWorstCase)->ArgsProduct({{100'000, 1'000'000}, {0, 1}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Stress<ChainedHashSet<int>>)->Arg(10'000'000)->Arg(100'000'000)->Iterations(1)->Unit(benchmark::kSecond);
+BENCHMARK(BM_Stress<FlatHashSet<int>>)->Arg(10'000'000)->Arg(100'000'000)->Iterations(1)->Unit(benchmark::kSecond);
+BENCHMARK(BM_StartupRebuild)->Arg(1'000'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_StartupMapped)->ArgsProduct({{1'000'000, 10'000'000}, {0, 1}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_IntersectionStd)->Arg(100'000)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Intersection<ChainedHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Intersection<PooledSet>)->ArgsProduct({{100'000, 1'000'000}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Intersection<FlatHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_UnionStd)->Arg(100'000)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Union<ChainedHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Union<FlatHashSet<int>>)->ArgsProduct({{100'000, 1'000'000}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Copy<ChainedHashSet<int>>)->Arg(10'000)->Arg(500'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Copy<PooledSet>)->Arg(10'000)->Arg(500'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Copy<FlatHashSet<int>>)->Arg(10'000)->Arg(500'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Copy<CowHashSet<ChainedHashSet<int>>>)->Arg(10'000)->Arg(500'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ConcurrentMix<GlobalLockSet>)->Arg(50)->Arg(90)->Arg(99)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_ConcurrentMix<ConcurrentHashSet<int>>)->Arg(50)->Arg(90)->Arg(99)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_ConcurrentMix<LockFreeHashSet<int>>)->Arg(50)->Arg(90)->Arg(99)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_ReadMostly<SharedLockSet>)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_ReadMostly<LeftRightHashSet<ChainedHashSet<int>>>)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
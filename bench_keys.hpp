@@ -0,0 +1,155 @@
+#ifndef BENCH_KEYS_HPP_
+#define BENCH_KEYS_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Key sets for the benchmark programs.  Every distribution gives n distinct
+// keys to insert, n distinct keys that are never inserted, and n lookups of
+// the inserted keys in the order a benchmark should issue them.
+namespace bench_keys {
+
+enum class Distribution {
+  kUniform,       // spread over all of int
+  kSequential,    // 0, 1, 2, ...
+  kNegative,      // spread over the negative ints
+  kZipf,          // spread over all of int, looked up with Zipfian skew
+  kPrimeStride    // multiples of a large prime, wrapping around int
+};
+
+inline constexpr Distribution kDistributions[] = {
+    Distribution::kUniform, Distribution::kSequential, Distribution::kNegative,
+    Distribution::kZipf, Distribution::kPrimeStride};
+
+inline const char* name(Distribution d) {
+  switch (d) {
+    case Distribution::kUniform:
+      return "uniform";
+    case Distribution::kSequential:
+      return "sequential";
+    case Distribution::kNegative:
+      return "negative";
+    case Distribution::kZipf:
+      return "zipf";
+    case Distribution::kPrimeStride:
+      return "prime_stride";
+  }
+  return "?";
+}
+
+struct Keys {
+  std::vector<int> present;   // to insert, in this order
+  std::vector<int> absent;    // never inserted
+  std::vector<int> hits;      // lookups of present keys, repeats allowed
+};
+
+// A bijection on the low bits of x that looks random: xor-shifts and odd
+// multipliers are both invertible modulo a power of two.  Scrambling
+// distinct counters therefore gives distinct keys without a set to check
+// against.
+inline std::uint32_t scramble(std::uint32_t x, unsigned bits) {
+  const std::uint32_t mask = (bits == 32) ? ~std::uint32_t {0} : (std::uint32_t {1} << bits) - 1;
+  x &= mask;
+  x ^= x >> 15;
+  x = (x * 0x2c1b3c6du) & mask;
+  x ^= x >> 12;
+  x = (x * 0x297a2d39u) & mask;
+  x ^= x >> 15;
+  return x;
+}
+
+// Ranks 0..n-1 drawn with probability proportional to 1 / (rank + 1)^theta,
+// by the method of Gray et al., "Quickly generating billion-record synthetic
+// databases" (as in YCSB): O(n) to set up, O(1) per draw.
+class Zipf {
+ private:
+  std::size_t n_;
+  double theta_;
+  double alpha_;
+  double zetaN_;
+  double eta_;
+
+  static double zeta(std::size_t n, double theta) {
+    double sum = 0;
+    for (std::size_t i = 1; i <= n; ++i) {
+      sum += 1 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+  }
+
+ public:
+  explicit Zipf(std::size_t n, double theta = 0.99)
+      : n_(n), theta_(theta), alpha_(1 / (1 - theta)), zetaN_(zeta(n, theta)) {
+    double zeta2 = zeta(std::min<std::size_t>(n, 2), theta);
+    eta_ = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetaN_);
+  }
+
+  template <typename Rng>
+  std::size_t operator()(Rng& rng) {
+    if (n_ < 2) {
+      return 0;
+    }
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    double uz = u * zetaN_;
+    if (uz < 1) {
+      return 0;
+    }
+    if (uz < 1 + std::pow(0.5, theta_)) {
+      return std::min<std::size_t>(1, n_ - 1);
+    }
+    auto rank = static_cast<std::size_t>(n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+    return std::min(rank, n_ - 1);
+  }
+};
+
+// The keys of distribution d for a set of n.  The same seed gives the same
+// keys.  Lookups other than Zipfian ones visit every present key once in a
+// shuffled order, so that no distribution walks memory in insertion order.
+inline Keys makeKeys(Distribution d, std::size_t n, unsigned seed) {
+  // another seed starts the counters elsewhere, so it gives other keys
+  const auto offset = static_cast<std::uint32_t>(seed) * 0x9e3779b9u;
+  auto key = [d, offset](std::size_t i) {
+    auto u = static_cast<std::uint32_t>(i);
+    switch (d) {
+      case Distribution::kSequential:
+        return static_cast<int>(u);
+      case Distribution::kNegative:
+        return -1 - static_cast<int>(scramble(u + offset, 31));
+      case Distribution::kPrimeStride:
+        return static_cast<int>(u * 1'000'003u);
+      default:
+        return static_cast<int>(scramble(u + offset, 32));
+    }
+  };
+
+  Keys keys;
+  keys.present.resize(n);
+  keys.absent.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    keys.present[i] = key(i);
+    keys.absent[i] = key(n + i);
+  }
+
+  std::mt19937_64 rng {seed};
+  if (d == Distribution::kZipf) {
+    // the hottest ranks fall on keys spread over the whole set
+    Zipf zipf(n);
+    keys.hits.resize(n);
+    for (int& k : keys.hits) {
+      k = keys.present[zipf(rng)];
+    }
+  }
+  else {
+    keys.hits = keys.present;
+    std::shuffle(keys.hits.begin(), keys.hits.end(), rng);
+  }
+  return keys;
+}
+
+}  // namespace bench_keys
+
+#endif      // BENCH_KEYS_HPP_
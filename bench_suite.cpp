@@ -0,0 +1,271 @@
+// The benchmark matrix: every HashSet operation, at every size from 10 to
+// 10M keys, for every key distribution of bench_keys.hpp, on both backends
+// and on std::unordered_set.
+//
+//   g++ -std=c++20 -O2 -march=native bench_suite.cpp -lbenchmark -pthread -o bench_suite
+//
+// Benchmarks are named operation/set/distribution/size, e.g.
+// ContainsMiss/flat/zipf/100000, so --benchmark_filter can pick a slice.
+// The whole matrix of 840 benchmarks takes about 50 minutes on one core,
+// most of it in the 10M-key rows; one set alone takes about a third of that.
+// Results are written as JSON to bench_suite.json unless --benchmark_out
+// names another file; two such files can be compared with compare.py from
+// Google Benchmark's tools.  Items per second counts keys.
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "bench_keys.hpp"
+#include "flat_hash.hpp"
+#include "hash.hpp"
+
+namespace {
+
+using bench_keys::Distribution;
+
+constexpr std::size_t kMinKeys = 10;
+constexpr std::size_t kMaxKeys = 10'000'000;
+
+// keys touched between two pauses of the timer; smaller sets are prepared
+// in batches so that pausing costs little next to the work measured
+constexpr std::size_t kBatchKeys = 100'000;
+
+// The keys of one distribution at every size.  Benchmarks are registered
+// distribution by distribution, so only the current one is kept.
+const bench_keys::Keys& keysFor(Distribution d, std::size_t n) {
+  static Distribution current = Distribution::kUniform;
+  static std::map<std::size_t, bench_keys::Keys> cache;
+  if (d != current) {
+    cache.clear();
+    current = d;
+  }
+  auto it = cache.find(n);
+  if (it == cache.end()) {
+    it = cache.emplace(n, bench_keys::makeKeys(d, n, 1'811)).first;
+  }
+  return it->second;
+}
+
+template <typename Set>
+Set filled(const std::vector<int>& keys) {
+  Set h;
+  for (int x : keys) {
+    h.insert(x);
+  }
+  return h;
+}
+
+template <typename Set>
+std::size_t bucketsOf(const Set& h) {
+  if constexpr (requires { h.bucketCount(); }) {
+    return h.bucketCount();
+  }
+  else {
+    return h.bucket_count();
+  }
+}
+
+// Runs op on each of a batch of sets made by make(), with the timer stopped
+// while they are made and destroyed.
+template <typename Set, typename Make, typename Op>
+void onBatches(benchmark::State& state, std::size_t n, Make make, Op op) {
+  const std::size_t batch = std::max<std::size_t>(1, kBatchKeys / n);
+  std::vector<Set> sets;
+  sets.reserve(batch);
+  for (auto _ : state) {
+    state.PauseTiming();
+    sets.clear();
+    for (std::size_t i = 0; i < batch; ++i) {
+      sets.push_back(make());
+    }
+    state.ResumeTiming();
+    for (Set& h : sets) {
+      op(h);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batch * n);
+}
+
+//*** Operations
+
+// n new keys into an empty set, growing it as it goes
+template <typename Set>
+void BM_InsertMiss(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  const bench_keys::Keys& keys = keysFor(d, n);
+  onBatches<Set>(state, n, [] { return Set(); }, [&keys](Set& h) {
+    for (int x : keys.present) {
+      h.insert(x);
+    }
+    benchmark::DoNotOptimize(h);
+  });
+}
+
+// keys that are already there
+template <typename Set>
+void BM_InsertHit(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  const bench_keys::Keys& keys = keysFor(d, n);
+  Set h = filled<Set>(keys.present);
+  for (auto _ : state) {
+    for (int x : keys.hits) {
+      h.insert(x);
+    }
+    benchmark::DoNotOptimize(h);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Set>
+void BM_ContainsHit(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  const bench_keys::Keys& keys = keysFor(d, n);
+  const Set h = filled<Set>(keys.present);
+  for (auto _ : state) {
+    std::size_t found = 0;
+    for (int x : keys.hits) {
+      found += h.contains(x);
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename Set>
+void BM_ContainsMiss(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  const bench_keys::Keys& keys = keysFor(d, n);
+  const Set h = filled<Set>(keys.present);
+  for (auto _ : state) {
+    std::size_t found = 0;
+    for (int x : keys.absent) {
+      found += h.contains(x);
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// every key of a full set, in insertion order, until it is empty
+template <typename Set>
+void BM_Erase(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  const bench_keys::Keys& keys = keysFor(d, n);
+  const Set h = filled<Set>(keys.present);
+  onBatches<Set>(state, n, [&h] { return Set(h); }, [&keys](Set& c) {
+    for (int x : keys.present) {
+      c.erase(x);
+    }
+    benchmark::DoNotOptimize(c);
+  });
+}
+
+template <typename Set>
+void BM_Iterate(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  Set h = filled<Set>(keysFor(d, n).present);
+  for (auto _ : state) {
+    std::int64_t sum = 0;
+    for (int x : h) {
+      sum += x;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// the copy constructor; copies are freed with the timer stopped
+template <typename Set>
+void BM_Copy(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  const Set h = filled<Set>(keysFor(d, n).present);
+  onBatches<Set>(state, n, [] { return Set(); }, [&h](Set& c) {
+    c = h;
+    benchmark::DoNotOptimize(c);
+  });
+}
+
+// to twice the bucket count, moving every key once
+template <typename Set>
+void BM_Rehash(benchmark::State& state, Distribution d) {
+  const std::size_t n = state.range(0);
+  const Set h = filled<Set>(keysFor(d, n).present);
+  const std::size_t target = 2 * bucketsOf(h);
+  onBatches<Set>(state, n, [&h] { return Set(h); }, [target](Set& c) {
+    c.rehash(target);
+    benchmark::DoNotOptimize(c);
+  });
+}
+
+//*** Registration
+
+// Run before every benchmark.  The 10M-key chained sets leave glibc's heap
+// in a state that made later benchmarks grow their tables up to twenty
+// times slower, depending only on what ran before them.
+void trimHeap(const benchmark::State&) {
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+}
+
+using Benchmark = void (*)(benchmark::State&, Distribution);
+
+template <typename Set>
+void registerSet(const char* set, Distribution d) {
+  const std::pair<const char*, Benchmark> operations[] = {
+      {"InsertMiss", BM_InsertMiss<Set>},     {"InsertHit", BM_InsertHit<Set>},
+      {"ContainsHit", BM_ContainsHit<Set>},   {"ContainsMiss", BM_ContainsMiss<Set>},
+      {"Erase", BM_Erase<Set>},               {"Iterate", BM_Iterate<Set>},
+      {"Copy", BM_Copy<Set>},                 {"Rehash", BM_Rehash<Set>}};
+  for (auto [operation, run] : operations) {
+    std::string name = std::string(operation) + "/" + set + "/" + bench_keys::name(d);
+    benchmark::RegisterBenchmark(name.c_str(), run, d)
+        ->Setup(trimHeap)
+        ->RangeMultiplier(10)
+        ->Range(kMinKeys, kMaxKeys);
+  }
+}
+
+void registerAll() {
+  for (Distribution d : bench_keys::kDistributions) {
+    registerSet<ChainedHashSet<int>>("chained", d);
+    registerSet<FlatHashSet<int>>("flat", d);
+    registerSet<std::unordered_set<int>>("std", d);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  registerAll();
+
+  std::vector<char*> args(argv, argv + argc);
+  bool named = std::any_of(args.begin(), args.end(), [](const char* arg) {
+    return std::strncmp(arg, "--benchmark_out=", 16) == 0;
+  });
+  std::string out = "--benchmark_out=bench_suite.json";
+  std::string format = "--benchmark_out_format=json";
+  if (!named) {
+    args.push_back(out.data());
+    args.push_back(format.data());
+  }
+
+  int count = static_cast<int>(args.size());
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,194 @@
+#ifndef BUCKET_POLICY_HPP_
+#define BUCKET_POLICY_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// A bucket policy decides which bucket counts a table may take and maps a
+// hash value to a bucket for the current count.  Every policy provides
+//   static constexpr sizes        the allowed bucket counts, increasing
+//   explicit Policy(count)        state for a table of count buckets
+//   std::size_t index(hash)       the bucket of hash, in [0, count)
+// The tables only ever construct a policy for a count taken from sizes.
+//
+// Every policy goes up to kMaxBuckets, far past what fits in memory, so a
+// table never runs out of sizes and keeps its load factor however many keys
+// it holds.
+
+namespace hashset_detail {
+
+// no table can hold more buckets than this: a bucket array of 2^61 8-byte
+// entries already covers the whole 64-bit address space
+inline constexpr std::size_t kMaxBuckets = std::size_t {1} << 61;
+
+// Deterministic Miller-Rabin: these twelve bases decide every n < 3.3 * 10^24.
+constexpr bool isPrime(std::uint64_t n) {
+  constexpr std::uint64_t bases[] {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+  if (n < 2) {
+    return false;
+  }
+  for (std::uint64_t p : bases) {
+    if (n % p == 0) {
+      return n == p;
+    }
+  }
+
+  auto mulmod = [n](std::uint64_t a, std::uint64_t b) {
+    return static_cast<std::uint64_t>(static_cast<unsigned __int128>(a) * b % n);
+  };
+  std::uint64_t d = n - 1;
+  int r = 0;
+  while (d % 2 == 0) {
+    d /= 2;
+    r++;
+  }
+  for (std::uint64_t a : bases) {
+    std::uint64_t x = 1;
+    for (std::uint64_t base = a, e = d; e != 0; e /= 2) {
+      if (e % 2 == 1) {
+        x = mulmod(x, base);
+      }
+      base = mulmod(base, base);
+    }
+    bool composite = (x != 1 && x != n - 1);
+    for (int i = 1; i < r && composite; ++i) {
+      x = mulmod(x, x);
+      composite = (x != n - 1);
+    }
+    if (composite) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The hand-picked primes up to about 2.9 million, then one prime for about
+// every factor of 1.5 up to kMaxBuckets.  The finer steps let large tables
+// grow by less than double (see growthTarget), and a table that asks for
+// twice its size gets at most 2.25 times.
+inline constexpr std::size_t kSmallPrimeCount = 18;
+
+constexpr std::size_t primeCount() {
+  std::size_t count = kSmallPrimeCount;
+  for (std::uint64_t p = 2'938'679; p + p / 2 <= kMaxBuckets; ++count) {
+    p += p / 2;
+    while (!isPrime(p)) {
+      p++;
+    }
+  }
+  return count;
+}
+
+constexpr std::array<std::size_t, primeCount()> primeSizes() {
+  std::array<std::size_t, primeCount()> s {1ul, 13ul, 59ul, 127ul, 257ul, 541ul,
+    1'109ul, 2'357ul, 5'087ul, 10'273ul, 20'753ul, 42'043ul,
+    85'229ul, 172'933ul, 351'061ul, 712'697ul, 1'447'153ul, 2'938'679ul};
+  for (std::size_t i = kSmallPrimeCount; i < s.size(); ++i) {
+    std::uint64_t p = s[i - 1] + s[i - 1] / 2;
+    while (!isPrime(p)) {
+      p++;
+    }
+    s[i] = p;
+  }
+  return s;
+}
+
+}  // namespace hashset_detail
+
+// The bucket count a full table asks for.  While the bucket array is small
+// the table doubles.  Past 2^24 buckets a rehash that briefly holds both the
+// old and the new array costs gigabytes, so the table grows by half instead;
+// policies whose sizes are powers of two round that up to double anyway.
+inline std::size_t growthTarget(std::size_t count) {
+  constexpr std::size_t kLargeTable = std::size_t {1} << 24;
+  if (count < kLargeTable) {
+    return count * 2;
+  }
+  return std::min(count + count / 2, hashset_detail::kMaxBuckets);
+}
+
+// Plain modulo by a prime.  One 64-bit division per call.
+struct PrimeModPolicy {
+  static constexpr auto sizes = hashset_detail::primeSizes();
+
+  explicit PrimeModPolicy(std::size_t count = sizes[0]) : count_(count) {}
+
+  std::size_t index(std::size_t hash) const {
+    return hash % count_;
+  }
+
+  std::size_t count_;
+};
+
+// Same buckets as PrimeModPolicy, but the remainder is computed with Lemire's
+// fastmod: multiplying by a precomputed 128-bit reciprocal of the divisor
+// leaves the fractional part of hash / count in the low bits, and one more
+// multiply by count moves the remainder into the high 64 bits.  The result is
+// exactly hash % count for every 64-bit hash, so bucket() does not change.
+struct PrimeFastModPolicy {
+  static constexpr auto sizes = PrimeModPolicy::sizes;
+
+  // ceil(2^128 / d) for every entry of sizes; d == 1 wraps to 0, which still
+  // yields 0 for every hash
+  static constexpr std::array<unsigned __int128, sizes.size()> magics = [] {
+    std::array<unsigned __int128, sizes.size()> m {};
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+      m[i] = ~static_cast<unsigned __int128>(0) / sizes[i] + 1;
+    }
+    return m;
+  }();
+
+  explicit PrimeFastModPolicy(std::size_t count = sizes[0])
+      : count_(count), magic_(~static_cast<unsigned __int128>(0) / count + 1) {
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+      if (sizes[i] == count) {
+        magic_ = magics[i];
+      }
+    }
+  }
+
+  std::size_t index(std::size_t hash) const {
+    unsigned __int128 lowbits = magic_ * hash;
+    unsigned __int128 bottom = ((lowbits & ~std::uint64_t {0}) * count_) >> 64;
+    unsigned __int128 top = (lowbits >> 64) * count_;
+    return static_cast<std::size_t>((bottom + top) >> 64);
+  }
+
+  std::size_t count_;
+  unsigned __int128 magic_;
+};
+
+// Power-of-two bucket counts, so the index is a mask.  Masking keeps only the
+// low bits, which identity hashes such as std::hash<int> leave badly
+// distributed, so the hash is run through a full 64-bit mixer first.
+struct Pow2MixPolicy {
+  static constexpr std::array<std::size_t, 62> sizes = [] {
+    std::array<std::size_t, 62> s {};
+    for (std::size_t i = 0; i < s.size(); ++i) {
+      s[i] = std::size_t {1} << i;
+    }
+    return s;
+  }();
+
+  explicit Pow2MixPolicy(std::size_t count = sizes[0]) : mask_(count - 1) {}
+
+  // the finaliser of MurmurHash3
+  static std::uint64_t mix(std::uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51'afd7'ed55'8ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ce'b9fe'1a85'ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  std::size_t index(std::size_t hash) const {
+    return mix(hash) & mask_;
+  }
+
+  std::size_t mask_;
+};
+
+#endif      // BUCKET_POLICY_HPP_
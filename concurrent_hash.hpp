@@ -0,0 +1,202 @@
+#ifndef CONCURRENT_HASH_HPP_
+#define CONCURRENT_HASH_HPP_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+#include "bucket_policy.hpp"
+#include "hash.hpp"
+
+// A thread-safe set made of independent shards.  Each key belongs to exactly
+// one shard, chosen by the high bits of its mixed hash, and every shard is a
+// separate Set behind its own reader/writer lock.  Lookups in different
+// shards never contend, and each shard grows and rehashes on its own, so a
+// rehash only blocks the keys of one shard.
+//
+// The shard is picked from the top bits and the bucket inside the shard from
+// the hash itself, so the two choices are independent.  Iterators are not
+// offered, since they could not outlive the lock; use forEach instead.
+template <typename Key, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Set = ChainedHashSet<Key, Hash, KeyEqual>>
+class ConcurrentHashSet {
+ private:
+  // shards are padded to this size so that two locks never share a line
+  static constexpr std::size_t kCacheLine = 64;
+
+  struct alignas(kCacheLine) Shard {
+    mutable std::shared_mutex lock;
+    Set set;
+  };
+
+  std::size_t shardBits_;
+  std::size_t shardCount_;
+  std::unique_ptr<Shard[]> shards;
+  [[no_unique_address]] Hash hash_;
+
+  std::size_t shardOf(const Key& key) const;
+
+ public:
+  using key_type = Key;
+  using value_type = Key;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+
+  // count, the number of shards, is rounded up to a power of two
+  explicit ConcurrentHashSet(std::size_t count = 64, const Hash& hash = Hash(),
+                             const KeyEqual& equal = KeyEqual());
+
+  ConcurrentHashSet(const ConcurrentHashSet&) = delete;
+  ConcurrentHashSet& operator=(const ConcurrentHashSet&) = delete;
+
+  // return whether key was inserted
+  bool insert(const Key& key);
+
+  bool contains(const Key& key) const;
+
+  // return whether key was erased
+  bool erase(const Key& key);
+
+  // inserts every key, taking each shard's lock once per call
+  void insertBatch(std::span<const Key> keys);
+
+  // remove every element, one shard at a time
+  void clear();
+
+  // return the number of elements.  Shards are counted one after the other,
+  // so with concurrent writers the result is only a snapshot.
+  std::size_t size() const;
+
+  bool empty() const;
+
+  std::size_t shardCount() const;
+
+  // calls f(key) for every element while holding each shard's read lock in
+  // turn.  f must not modify the set.
+  template <typename F>
+  void forEach(F f) const;
+};
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+ConcurrentHashSet<Key, Hash, KeyEqual, Set>::ConcurrentHashSet(
+    std::size_t count, const Hash& hash, const KeyEqual& equal)
+    : shardBits_(std::bit_width(std::max<std::size_t>(count, 1) - 1)),
+      shardCount_(std::size_t {1} << shardBits_),
+      shards(std::make_unique<Shard[]>(shardCount_)), hash_(hash) {
+  for (std::size_t i = 0; i < shardCount_; ++i) {
+    shards[i].set = Set(hash, equal);
+  }
+}
+
+// The hash is mixed first: std::hash<int> is the identity, whose top bits
+// would put every small key in shard 0.
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+std::size_t ConcurrentHashSet<Key, Hash, KeyEqual, Set>::shardOf(const Key& key) const {
+  if (shardBits_ == 0) {
+    return 0;
+  }
+  return Pow2MixPolicy::mix(hash_(key)) >> (64 - shardBits_);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+bool ConcurrentHashSet<Key, Hash, KeyEqual, Set>::insert(const Key& key) {
+  Shard& shard = shards[shardOf(key)];
+  std::unique_lock lock {shard.lock};
+  return shard.set.insert(key).second;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+bool ConcurrentHashSet<Key, Hash, KeyEqual, Set>::contains(const Key& key) const {
+  const Shard& shard = shards[shardOf(key)];
+  std::shared_lock lock {shard.lock};
+  return shard.set.contains(key);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+bool ConcurrentHashSet<Key, Hash, KeyEqual, Set>::erase(const Key& key) {
+  Shard& shard = shards[shardOf(key)];
+  std::unique_lock lock {shard.lock};
+  std::size_t before = shard.set.size();
+  shard.set.erase(key);
+  return shard.set.size() != before;
+}
+
+// Keys are sorted by shard with a counting sort, then each shard takes its
+// keys in one batch under a single lock.
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+void ConcurrentHashSet<Key, Hash, KeyEqual, Set>::insertBatch(std::span<const Key> keys) {
+  std::vector<std::size_t> start(shardCount_ + 1, 0);
+  std::vector<std::size_t> shardIdx(keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    shardIdx[i] = shardOf(keys[i]);
+    start[shardIdx[i] + 1]++;
+  }
+  for (std::size_t s = 0; s < shardCount_; ++s) {
+    start[s + 1] += start[s];
+  }
+
+  std::vector<Key> sorted(keys.size());
+  std::vector<std::size_t> fill(start.begin(), start.end() - 1);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    sorted[fill[shardIdx[i]]++] = keys[i];
+  }
+
+  for (std::size_t s = 0; s < shardCount_; ++s) {
+    if (start[s] == start[s + 1]) {
+      continue;
+    }
+    std::unique_lock lock {shards[s].lock};
+    shards[s].set.insertBatch(std::span<const Key>(sorted).subspan(start[s], start[s + 1] - start[s]));
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+void ConcurrentHashSet<Key, Hash, KeyEqual, Set>::clear() {
+  for (std::size_t s = 0; s < shardCount_; ++s) {
+    std::unique_lock lock {shards[s].lock};
+    shards[s].set.clear();
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+std::size_t ConcurrentHashSet<Key, Hash, KeyEqual, Set>::size() const {
+  std::size_t total = 0;
+  for (std::size_t s = 0; s < shardCount_; ++s) {
+    std::shared_lock lock {shards[s].lock};
+    total += shards[s].set.size();
+  }
+  return total;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+bool ConcurrentHashSet<Key, Hash, KeyEqual, Set>::empty() const {
+  return size() == 0;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+std::size_t ConcurrentHashSet<Key, Hash, KeyEqual, Set>::shardCount() const {
+  return shardCount_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Set>
+template <typename F>
+void ConcurrentHashSet<Key, Hash, KeyEqual, Set>::forEach(F f) const {
+  for (std::size_t s = 0; s < shardCount_; ++s) {
+    std::shared_lock lock {shards[s].lock};
+    // Set::begin() is not const, but nothing is modified through it
+    Set& set = const_cast<Set&>(shards[s].set);
+    for (const Key& key : set) {
+      f(key);
+    }
+  }
+}
+
+#endif      // CONCURRENT_HASH_HPP_
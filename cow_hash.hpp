@@ -0,0 +1,197 @@
+#ifndef COW_HASH_HPP_
+#define COW_HASH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include "hash.hpp"
+
+// Copy-on-write clones of a hash set.  Copying a CowHashSet only shares the
+// underlying Set; the first mutating call on a clone whose storage is shared
+// gives that clone a private copy.  Inserting a key that is already present
+// or erasing one that is not is not a mutation and does not copy.
+//
+// Lookups and iteration go through the Set's const interface, so reading a
+// shared clone never copies it.  Iterators are read-only and point into the
+// storage the clone used when they were made: they stay valid until the
+// clone writes, which may give it a private copy, or the storage changes
+// under the rules of Set.  Like the sets themselves, clones that share
+// storage must not be used from several threads at once.
+template <typename Set = HashSet>
+class CowHashSet {
+ private:
+  std::shared_ptr<Set> set_;
+
+  // the set this clone may write to, copied first if it is shared
+  Set& mutate() {
+    if (set_.use_count() > 1) {
+      set_ = std::make_shared<Set>(*set_);
+    }
+    return *set_;
+  }
+
+  template <typename K>
+  std::pair<typename Set::const_iterator, bool> insertKey(K&& key);
+
+ public:
+  using Iterator = typename Set::const_iterator;
+  using const_iterator = Iterator;
+  using key_type = typename Set::key_type;
+  using value_type = typename Set::value_type;
+  using Key = key_type;
+
+  CowHashSet() : set_(std::make_shared<Set>()) {}
+
+  explicit CowHashSet(Set set) : set_(std::make_shared<Set>(std::move(set))) {}
+
+  // copies share storage.  There is no move constructor, so a moved-from
+  // clone keeps sharing too instead of being left without a set.
+  CowHashSet(const CowHashSet&) = default;
+  CowHashSet& operator=(const CowHashSet&) = default;
+
+  // return whether another clone currently shares this one's storage
+  bool shared() const {
+    return set_.use_count() > 1;
+  }
+
+  // read-only access to the whole interface of the underlying set
+  const Set& get() const {
+    return *set_;
+  }
+
+  //*** Core Level 1 functionality
+
+  std::pair<Iterator, bool> insert(const Key& key) {
+    return insertKey(key);
+  }
+
+  std::pair<Iterator, bool> insert(Key&& key) {
+    return insertKey(std::move(key));
+  }
+
+  bool contains(const Key& key) const {
+    return set_->contains(key);
+  }
+
+  void erase(const Key& key) {
+    if (!shared() || set_->contains(key)) {
+      mutate().erase(key);
+    }
+  }
+
+  void rehash(std::size_t newSize) {
+    mutate().rehash(newSize);
+  }
+
+  void shrink_to_fit() {
+    mutate().shrink_to_fit();
+  }
+
+  void clear() {
+    if (shared()) {
+      // start from an empty set configured like this one, not a default one
+      using Allocator = typename Set::allocator_type;
+      auto empty = std::make_shared<Set>(set_->hash_function(), set_->key_eq(),
+          std::allocator_traits<Allocator>::select_on_container_copy_construction(set_->get_allocator()));
+      empty->maxLoadFactor(set_->maxLoadFactor());
+      empty->minLoadFactor(set_->minLoadFactor());
+      set_ = std::move(empty);
+    }
+    else {
+      set_->clear();
+    }
+  }
+
+  //*** Batched functionality
+
+  std::size_t containsBatch(std::span<const Key> keys, std::span<std::uint64_t> out) const {
+    return set_->containsBatch(keys, out);
+  }
+
+  void insertBatch(std::span<const Key> keys) {
+    mutate().insertBatch(keys);
+  }
+
+  //*** Core Level 2 functionality
+
+  Iterator find(const Key& key) const {
+    return std::as_const(*set_).find(key);
+  }
+
+  // it may point into storage that is still shared, so the key is looked up
+  // again in the set this clone writes to
+  Iterator erase(Iterator it) {
+    Set& set = mutate();
+    return set.erase(set.find(*it));
+  }
+
+  //*** Utility functions
+
+  std::size_t size() const {
+    return set_->size();
+  }
+
+  bool empty() const {
+    return set_->empty();
+  }
+
+  std::size_t bucketCount() const {
+    return set_->bucketCount();
+  }
+
+  std::size_t bucketSize(std::size_t b) const {
+    return set_->bucketSize(b);
+  }
+
+  std::size_t bucket(const Key& key) const {
+    return set_->bucket(key);
+  }
+
+  float loadFactor() const {
+    return set_->loadFactor();
+  }
+
+  float maxLoadFactor() const {
+    return set_->maxLoadFactor();
+  }
+
+  void maxLoadFactor(float maxLoad) {
+    mutate().maxLoadFactor(maxLoad);
+  }
+
+  float minLoadFactor() const {
+    return set_->minLoadFactor();
+  }
+
+  void minLoadFactor(float minLoad) {
+    mutate().minLoadFactor(minLoad);
+  }
+
+  //*** Iterator Functionality
+
+  Iterator begin() const {
+    return std::as_const(*set_).begin();
+  }
+
+  Iterator end() const {
+    return std::as_const(*set_).end();
+  }
+};
+
+// a key already in shared storage is found there rather than copying it
+template <typename Set>
+template <typename K>
+auto CowHashSet<Set>::insertKey(K&& key) -> std::pair<Iterator, bool> {
+  if (shared()) {
+    Iterator it = find(key);
+    if (it != end()) {
+      return {it, false};
+    }
+  }
+  auto [it, inserted] = mutate().insert(std::forward<K>(key));
+  return {Iterator(it), inserted};
+}
+
+#endif      // COW_HASH_HPP_
@@ -0,0 +1,260 @@
+// hashset-dedup: writes the first occurrence of every integer in its input.
+//
+//   g++ -std=c++20 -O2 -march=native -pthread dedup.cpp -o hashset-dedup
+//
+//   hashset-dedup [options] [file...]
+//     -f, --format text|bin32|bin64   input and output format (default text)
+//     -j, --threads N                 parser threads (default: all cores)
+//     -e, --expect N                  expected number of distinct keys
+//     -o, --output FILE               write to FILE instead of stdout
+//     -q, --quiet                     no throughput report on stderr
+//
+// With no file, or "-", standard input is read.  Regular files are mapped and
+// parsed in place; pipes are read in large blocks.  Either way the input goes
+// through in windows of kWindow bytes, each parsed on all threads and then
+// filtered in order.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dedup.hpp"
+
+namespace {
+
+using hashset_dedup::Format;
+
+// bytes parsed per round; large enough to keep every thread busy, small
+// enough that the parsed keys of a window stay a modest multiple of it
+constexpr std::size_t kWindow = std::size_t {64} << 20;
+
+struct Options {
+  Format format = Format::kText;
+  std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::size_t expected = 0;
+  std::string output;
+  bool quiet = false;
+  std::vector<std::string> inputs;
+};
+
+struct Totals {
+  std::size_t bytes = 0;
+  std::size_t keys = 0;
+  std::size_t unique = 0;
+};
+
+[[noreturn]] void usage(const char* message) {
+  std::fprintf(stderr, "hashset-dedup: %s\n"
+               "usage: hashset-dedup [-f text|bin32|bin64] [-j threads] [-e expected]"
+               " [-o output] [-q] [file...]\n", message);
+  std::exit(2);
+}
+
+std::size_t parseCount(const char* text) {
+  char* end = nullptr;
+  unsigned long long n = std::strtoull(text, &end, 10);
+  if (end == text || *end != '\0') {
+    usage("expected a number");
+  }
+  return static_cast<std::size_t>(n);
+}
+
+Options parseOptions(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto value = [&]() {
+      if (i + 1 == argc) {
+        usage("missing option value");
+      }
+      return argv[++i];
+    };
+    if (arg == "-f" || arg == "--format") {
+      std::string_view f = value();
+      if (f == "text") {
+        options.format = Format::kText;
+      }
+      else if (f == "bin32") {
+        options.format = Format::kBinary32;
+      }
+      else if (f == "bin64") {
+        options.format = Format::kBinary64;
+      }
+      else {
+        usage("unknown format");
+      }
+    }
+    else if (arg == "-j" || arg == "--threads") {
+      options.threads = std::max<std::size_t>(parseCount(value()), 1);
+    }
+    else if (arg == "-e" || arg == "--expect") {
+      options.expected = parseCount(value());
+    }
+    else if (arg == "-o" || arg == "--output") {
+      options.output = value();
+    }
+    else if (arg == "-q" || arg == "--quiet") {
+      options.quiet = true;
+    }
+    else if (arg.size() > 1 && arg[0] == '-') {
+      usage("unknown option");
+    }
+    else {
+      options.inputs.emplace_back(arg);
+    }
+  }
+  if (options.inputs.empty()) {
+    options.inputs.emplace_back("-");
+  }
+  return options;
+}
+
+// parses one window, filters it and writes what is new
+void process(std::string_view window, std::size_t offset, const Options& options,
+             hashset_dedup::Deduper& deduper, hashset_dedup::Output& out, Totals& totals) {
+  auto pieces = hashset_dedup::parseParallel(window, options.format, offset, options.threads);
+  for (std::vector<std::int64_t>& keys : pieces) {
+    std::size_t kept = deduper.filter(keys);
+    out.write(std::span<const std::int64_t>(keys).first(kept));
+    totals.keys += keys.size();
+    totals.unique += kept;
+  }
+  totals.bytes += window.size();
+}
+
+// A regular file is mapped and its windows are views into the mapping, so
+// the input is never copied.
+void processMapped(int fd, std::size_t length, const std::string& name, const Options& options,
+                   hashset_dedup::Deduper& deduper, hashset_dedup::Output& out, Totals& totals) {
+  if (length == 0) {
+    return;
+  }
+  void* map = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    hashset_detail::throwErrno("cannot map " + name);
+  }
+  ::madvise(map, length, MADV_SEQUENTIAL);
+  std::string_view all(static_cast<const char*>(map), length);
+
+  try {
+    std::size_t pos = 0;
+    while (pos < length) {
+      std::string_view rest = all.substr(pos);
+      bool last = rest.size() <= kWindow;
+      std::size_t n = last ? rest.size()
+                           : hashset_dedup::completePrefix(rest.substr(0, kWindow), options.format, false);
+      if (n == 0) {
+        // one text record longer than a window: take it whole
+        n = hashset_dedup::completePrefix(rest, options.format, false);
+        n = (n == 0) ? rest.size() : n;
+      }
+      process(rest.substr(0, n), pos, options, deduper, out, totals);
+      pos += n;
+    }
+  }
+  catch (...) {
+    ::munmap(map, length);
+    throw;
+  }
+  ::munmap(map, length);
+}
+
+// Pipes are read into a buffer; a record cut off at the end of one block is
+// moved to the front and completed by the next.
+void processStream(int fd, const std::string& name, const Options& options,
+                   hashset_dedup::Deduper& deduper, hashset_dedup::Output& out, Totals& totals) {
+  std::vector<char> buffer(kWindow);
+  std::size_t filled = 0;
+  std::size_t offset = 0;
+  bool atEnd = false;
+  while (!atEnd) {
+    if (filled == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+    ssize_t r = ::read(fd, buffer.data() + filled, buffer.size() - filled);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      hashset_detail::throwErrno("cannot read " + name);
+    }
+    filled += static_cast<std::size_t>(r);
+    atEnd = (r == 0);
+    if (!atEnd && filled < buffer.size()) {
+      continue;
+    }
+
+    std::string_view data(buffer.data(), filled);
+    std::size_t n = hashset_dedup::completePrefix(data, options.format, atEnd);
+    process(data.substr(0, n), offset, options, deduper, out, totals);
+    std::copy(buffer.begin() + n, buffer.begin() + filled, buffer.begin());
+    filled -= n;
+    offset += n;
+  }
+}
+
+void processInput(const std::string& name, const Options& options,
+                  hashset_dedup::Deduper& deduper, hashset_dedup::Output& out, Totals& totals) {
+  int fd = (name == "-") ? STDIN_FILENO : ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    hashset_detail::throwErrno("cannot open " + name);
+  }
+  hashset_detail::FileHandle owner {(fd == STDIN_FILENO) ? -1 : fd};
+
+  struct stat st {};
+  if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    processMapped(fd, static_cast<std::size_t>(st.st_size), name, options, deduper, out, totals);
+  }
+  else {
+    processStream(fd, name, options, deduper, out, totals);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options = parseOptions(argc, argv);
+
+  try {
+    int outFd = STDOUT_FILENO;
+    if (!options.output.empty()) {
+      outFd = ::open(options.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (outFd < 0) {
+        hashset_detail::throwErrno("cannot create " + options.output);
+      }
+    }
+    hashset_detail::FileHandle outOwner {(outFd == STDOUT_FILENO) ? -1 : outFd};
+
+    auto start = std::chrono::steady_clock::now();
+    hashset_dedup::Deduper deduper(options.expected);
+    hashset_dedup::Output out(outFd, options.format);
+    Totals totals;
+    for (const std::string& name : options.inputs) {
+      processInput(name, options, deduper, out, totals);
+    }
+    out.flush();
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+    if (!options.quiet) {
+      double seconds = std::max(took.count(), 1e-9);
+      std::fprintf(stderr,
+                   "hashset-dedup: %zu keys, %zu unique, %.1f MB in, %.1f MB out in %.3f s"
+                   " (%.1f M keys/s, %.1f MB/s)\n",
+                   totals.keys, totals.unique, totals.bytes / 1e6, out.bytesWritten() / 1e6,
+                   seconds, totals.keys / seconds / 1e6, totals.bytes / seconds / 1e6);
+    }
+  }
+  catch (const std::exception& e) {
+    std::fprintf(stderr, "hashset-dedup: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
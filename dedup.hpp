@@ -0,0 +1,272 @@
+#ifndef DEDUP_HPP_
+#define DEDUP_HPP_
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "flat_hash.hpp"
+
+// The pieces of hashset-dedup (dedup.cpp): parsing integers out of a buffer
+// on several threads, keeping the first occurrence of each key, and writing
+// the survivors back out.  Input arrives in windows that begin and end on a
+// record boundary; each window is parsed in parallel and then filtered in
+// order, so the output keeps the order of first occurrences.
+namespace hashset_dedup {
+
+enum class Format {
+  kText,        // decimal integers separated by whitespace
+  kBinary32,    // native-endian std::int32_t records
+  kBinary64     // native-endian std::int64_t records
+};
+
+inline std::size_t recordSize(Format format) {
+  return (format == Format::kBinary32) ? 4 : 8;
+}
+
+inline bool isSpace(char c) {
+  return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+// Length of the longest prefix of bytes that ends on a record boundary: after
+// the last whitespace for text, a whole number of records for binary.  With
+// atEnd the input is complete and everything counts.
+inline std::size_t completePrefix(std::string_view bytes, Format format, bool atEnd) {
+  if (atEnd) {
+    return bytes.size();
+  }
+  if (format != Format::kText) {
+    return bytes.size() / recordSize(format) * recordSize(format);
+  }
+  std::size_t i = bytes.size();
+  while (i > 0 && !isSpace(bytes[i - 1])) {
+    --i;
+  }
+  return i;
+}
+
+// Appends the keys of bytes, which holds whole records, to out.  offset is the
+// position of bytes in the input and only used for error messages.
+inline void parse(std::string_view bytes, Format format, std::size_t offset,
+                  std::vector<std::int64_t>& out) {
+  if (format == Format::kBinary32) {
+    if (bytes.size() % 4 != 0) {
+      throw std::runtime_error("input ends in a partial 4-byte record");
+    }
+    for (std::size_t i = 0; i < bytes.size(); i += 4) {
+      std::int32_t key;
+      std::memcpy(&key, bytes.data() + i, 4);
+      out.push_back(key);
+    }
+    return;
+  }
+  if (format == Format::kBinary64) {
+    if (bytes.size() % 8 != 0) {
+      throw std::runtime_error("input ends in a partial 8-byte record");
+    }
+    std::size_t first = out.size();
+    out.resize(first + bytes.size() / 8);
+    std::memcpy(out.data() + first, bytes.data(), bytes.size());
+    return;
+  }
+
+  const char* p = bytes.data();
+  const char* end = p + bytes.size();
+  while (true) {
+    while (p != end && isSpace(*p)) {
+      ++p;
+    }
+    if (p == end) {
+      return;
+    }
+    std::int64_t key;
+    auto [next, ec] = std::from_chars(p, end, key);
+    if (ec != std::errc() || (next != end && !isSpace(*next))) {
+      throw std::runtime_error("not an integer at byte " +
+                               std::to_string(offset + (p - bytes.data())));
+    }
+    out.push_back(key);
+    p = next;
+  }
+}
+
+// Parses bytes with up to threads workers, each taking a contiguous piece cut
+// at a record boundary.  Concatenating the pieces in order gives the keys in
+// input order.
+inline std::vector<std::vector<std::int64_t>> parseParallel(std::string_view bytes, Format format,
+                                                            std::size_t offset, std::size_t threads) {
+  // below this a piece is not worth a thread
+  constexpr std::size_t kMinPiece = 1 << 16;
+  threads = std::clamp<std::size_t>(bytes.size() / kMinPiece, 1, std::max<std::size_t>(threads, 1));
+
+  std::vector<std::size_t> cuts {0};
+  for (std::size_t t = 1; t < threads; ++t) {
+    std::size_t cut = std::max(cuts.back(), bytes.size() * t / threads);
+    if (format == Format::kText) {
+      while (cut < bytes.size() && !isSpace(bytes[cut])) {
+        ++cut;
+      }
+    }
+    else {
+      cut -= cut % recordSize(format);
+    }
+    cuts.push_back(cut);
+  }
+  cuts.push_back(bytes.size());
+
+  std::vector<std::vector<std::int64_t>> pieces(threads);
+  std::vector<std::exception_ptr> errors(threads);
+  auto work = [&](std::size_t t) {
+    try {
+      pieces[t].reserve((cuts[t + 1] - cuts[t]) / (format == Format::kText ? 4 : recordSize(format)));
+      parse(bytes.substr(cuts[t], cuts[t + 1] - cuts[t]), format, offset + cuts[t], pieces[t]);
+    }
+    catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (std::size_t t = 1; t < threads; ++t) {
+    workers.emplace_back(work, t);
+  }
+  work(0);
+  for (std::thread& w : workers) {
+    w.join();
+  }
+  for (std::exception_ptr& e : errors) {
+    if (e) {
+      std::rethrow_exception(e);
+    }
+  }
+  return pieces;
+}
+
+// Remembers every key seen so far.  filter() keeps the keys seen for the
+// first time and drops the rest.
+class Deduper {
+ private:
+  // keys resolved per containsBatch call
+  static constexpr std::size_t kBlock = 1024;
+
+  FlatHashSet<std::int64_t> seen;
+
+ public:
+  // expected is the number of distinct keys, if known, to size the set once
+  explicit Deduper(std::size_t expected = 0) {
+    seen.reserve(expected);
+  }
+
+  // Compacts keys in place to the ones not seen before, in their original
+  // order, and returns how many there are.  Lookups are batched so that the
+  // cache misses of repeated keys overlap; only misses go on to insert, which
+  // also catches repeats within the block.
+  std::size_t filter(std::span<std::int64_t> keys) {
+    std::uint64_t mask[kBlock / 64];
+    std::size_t kept = 0;
+    for (std::size_t start = 0; start < keys.size(); start += kBlock) {
+      std::size_t n = std::min(kBlock, keys.size() - start);
+      seen.containsBatch(keys.subspan(start, n), mask);
+      for (std::size_t i = 0; i < n; ++i) {
+        if ((mask[i / 64] >> (i % 64)) & 1) {
+          continue;
+        }
+        if (seen.insert(keys[start + i]).second) {
+          keys[kept++] = keys[start + i];
+        }
+      }
+    }
+    return kept;
+  }
+
+  std::size_t distinct() const {
+    return seen.size();
+  }
+};
+
+// Buffered writer for the surviving keys.  Binary records go out straight
+// from the caller's array; text is formatted into one large buffer that is
+// written whenever it fills up.
+class Output {
+ private:
+  static constexpr std::size_t kBufferSize = 1 << 20;
+
+  int fd_;
+  Format format_;
+  std::vector<char> buffer;
+  std::size_t used_;
+  std::size_t bytes_;
+
+  void writeAll(const char* data, std::size_t n) {
+    while (n > 0) {
+      ssize_t w = ::write(fd_, data, n);
+      if (w < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::system_error(errno, std::generic_category(), "write failed");
+      }
+      data += w;
+      n -= static_cast<std::size_t>(w);
+      bytes_ += static_cast<std::size_t>(w);
+    }
+  }
+
+ public:
+  Output(int fd, Format format)
+      : fd_(fd), format_(format), buffer(kBufferSize), used_(0), bytes_(0) {}
+
+  Output(const Output&) = delete;
+  Output& operator=(const Output&) = delete;
+
+  void write(std::span<const std::int64_t> keys) {
+    if (format_ == Format::kBinary64) {
+      flush();
+      writeAll(reinterpret_cast<const char*>(keys.data()), keys.size_bytes());
+      return;
+    }
+    for (std::int64_t key : keys) {
+      // the longest record: "-9223372036854775808\n"
+      if (kBufferSize - used_ < 21) {
+        flush();
+      }
+      if (format_ == Format::kBinary32) {
+        auto narrow = static_cast<std::int32_t>(key);
+        std::memcpy(buffer.data() + used_, &narrow, 4);
+        used_ += 4;
+      }
+      else {
+        used_ = std::to_chars(buffer.data() + used_, buffer.data() + kBufferSize, key).ptr -
+                buffer.data();
+        buffer[used_++] = '\n';
+      }
+    }
+  }
+
+  void flush() {
+    writeAll(buffer.data(), used_);
+    used_ = 0;
+  }
+
+  // bytes handed to the file descriptor so far
+  std::size_t bytesWritten() const {
+    return bytes_;
+  }
+};
+
+}  // namespace hashset_dedup
+
+#endif      // DEDUP_HPP_
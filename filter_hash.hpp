@@ -0,0 +1,262 @@
+#ifndef FILTER_HASH_HPP_
+#define FILTER_HASH_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "bucket_policy.hpp"
+#include "hash.hpp"
+
+// A split block Bloom filter over 64-bit hashes.  Each hash picks one 32-byte
+// block and sets one bit in every 32-bit word of it, so a lookup reads half a
+// cache line and nothing else.  Bits are never cleared: a hash stays in the
+// filter until the filter is rebuilt.
+class BlockFilter {
+ private:
+  struct alignas(32) Block {
+    std::array<std::uint32_t, 8> words {};
+  };
+
+  // odd multipliers, one per word, that pick the bit set in that word
+  static constexpr std::array<std::uint32_t, 8> kSalts = {
+      0x47b6'137bu, 0x4497'4d91u, 0x8824'ad5bu, 0xa2b7'289du,
+      0x7054'95c7u, 0x2df1'424bu, 0x9efc'4947u, 0x5c6b'fb31u};
+
+  std::vector<Block> blocks;
+
+  // the block comes from the high half of the hash, scaled to the block count
+  std::size_t blockOf(std::uint64_t hash) const {
+    return static_cast<std::size_t>(((hash >> 32) * blocks.size()) >> 32);
+  }
+
+  // the bits come from the low half
+  static std::uint32_t bitOf(std::uint64_t hash, std::size_t word) {
+    return std::uint32_t {1} << ((static_cast<std::uint32_t>(hash) * kSalts[word]) >> 27);
+  }
+
+ public:
+  // filter bits per key it is sized for, for about 0.5% false positives
+  static constexpr std::size_t kBitsPerKey = 12;
+
+  explicit BlockFilter(std::size_t keys = 0)
+      : blocks(std::max<std::size_t>(1, (keys * kBitsPerKey + 255) / 256)) {}
+
+  void add(std::uint64_t hash) {
+    Block& block = blocks[blockOf(hash)];
+    for (std::size_t i = 0; i < block.words.size(); ++i) {
+      block.words[i] |= bitOf(hash, i);
+    }
+  }
+
+  // false means the hash was never added; true may be a false positive
+  bool mayContain(std::uint64_t hash) const {
+    const Block& block = blocks[blockOf(hash)];
+    std::uint32_t missing = 0;
+    for (std::size_t i = 0; i < block.words.size(); ++i) {
+      missing |= ~block.words[i] & bitOf(hash, i);
+    }
+    return missing == 0;
+  }
+
+  std::size_t bytes() const {
+    return blocks.size() * sizeof(Block);
+  }
+};
+
+// A set with a BlockFilter in front of it, for workloads where most lookups
+// miss.  contains() and find() first ask the filter, and a key it rules out
+// never touches the buckets or the nodes of the set.  Lookups that hit pay
+// for the filter on top of the set, so this only pays off when misses are
+// common, and mostly in front of ChainedHashSet: a miss in FlatHashSet
+// already costs a single control group.
+//
+// The filter holds the mixed hash of every key inserted since it was built.
+// It is rebuilt from the set whenever the bucket count of the set changes,
+// that is on every rehash, shrink or clear, and also once more keys have gone
+// into it than it was sized for, so that churn cannot fill it up with keys
+// that have long been erased.  Erasing alone leaves it as it is.
+template <typename Set = HashSet>
+class FilteredHashSet {
+ public:
+  using Iterator = typename Set::Iterator;
+  using key_type = typename Set::key_type;
+  using value_type = typename Set::value_type;
+  using Key = key_type;
+
+ private:
+  // the smallest number of keys a filter is sized for
+  static constexpr std::size_t kMinFilterKeys = 64;
+
+  Set set_;
+  [[no_unique_address]] typename Set::hasher hash_;
+  BlockFilter filter_;
+  // keys added to the filter since it was built, and how many it was built for
+  std::size_t added_;
+  std::size_t capacity_;
+  // the bucket count of the set when the filter was built
+  std::size_t buckets_;
+
+  // std::hash<int> is the identity, so the hash is mixed before the filter
+  // takes its block and bits from it
+  std::uint64_t filterHash(const Key& key) const {
+    return Pow2MixPolicy::mix(hash_(key));
+  }
+
+  // room for twice the keys there are now, so a rebuild lasts at least as
+  // many inserts as it visited keys
+  void rebuildFilter() {
+    capacity_ = std::max(kMinFilterKeys, 2 * set_.size());
+    filter_ = BlockFilter(capacity_);
+    set_.forEachInPart(0, 1, [this](const Key& key) {
+      filter_.add(filterHash(key));
+    });
+    added_ = set_.size();
+    buckets_ = set_.bucketCount();
+  }
+
+  // rebuilds the filter if the set has rehashed or the filter is full
+  void syncFilter() {
+    if (set_.bucketCount() != buckets_ || added_ > capacity_) {
+      rebuildFilter();
+    }
+  }
+
+  void inserted(std::uint64_t hash) {
+    filter_.add(hash);
+    added_++;
+    syncFilter();
+  }
+
+ public:
+  explicit FilteredHashSet(Set set = Set())
+      : set_(std::move(set)), hash_(set_.hash_function()), added_(0), capacity_(0),
+        buckets_(0) {
+    rebuildFilter();
+  }
+
+  // the set behind the filter.  Lookups made through it skip the filter and
+  // always search the table
+  const Set& get() const {
+    return set_;
+  }
+
+  // false means key is not in the set, without looking at the set
+  bool mayContain(const Key& key) const {
+    return filter_.mayContain(filterHash(key));
+  }
+
+  // the memory taken by the filter
+  std::size_t filterBytes() const {
+    return filter_.bytes();
+  }
+
+  //*** Core Level 1 functionality
+
+  std::pair<Iterator, bool> insert(const Key& key) {
+    auto result = set_.insert(key);
+    if (result.second) {
+      inserted(filterHash(key));
+    }
+    return result;
+  }
+
+  std::pair<Iterator, bool> insert(Key&& key) {
+    std::uint64_t hash = filterHash(key);
+    auto result = set_.insert(std::move(key));
+    if (result.second) {
+      inserted(hash);
+    }
+    return result;
+  }
+
+  bool contains(const Key& key) const {
+    return mayContain(key) && set_.contains(key);
+  }
+
+  void erase(const Key& key) {
+    set_.erase(key);
+    syncFilter();
+  }
+
+  void rehash(std::size_t newSize) {
+    set_.rehash(newSize);
+    syncFilter();
+  }
+
+  void reserve(std::size_t n) {
+    set_.reserve(n);
+    syncFilter();
+  }
+
+  // also drops the erased keys from the filter
+  void shrink_to_fit() {
+    set_.shrink_to_fit();
+    rebuildFilter();
+  }
+
+  void clear() {
+    set_.clear();
+    rebuildFilter();
+  }
+
+  //*** Core Level 2 functionality
+
+  Iterator find(const Key& key) {
+    return mayContain(key) ? set_.find(key) : set_.end();
+  }
+
+  // like the sets, never shrinks, so the filter is left as it is
+  Iterator erase(Iterator it) {
+    return set_.erase(it);
+  }
+
+  //*** Utility functions
+
+  std::size_t size() const {
+    return set_.size();
+  }
+
+  bool empty() const {
+    return set_.empty();
+  }
+
+  std::size_t bucketCount() const {
+    return set_.bucketCount();
+  }
+
+  float loadFactor() const {
+    return set_.loadFactor();
+  }
+
+  float maxLoadFactor() const {
+    return set_.maxLoadFactor();
+  }
+
+  void maxLoadFactor(float maxLoad) {
+    set_.maxLoadFactor(maxLoad);
+    syncFilter();
+  }
+
+  float minLoadFactor() const {
+    return set_.minLoadFactor();
+  }
+
+  void minLoadFactor(float minLoad) {
+    set_.minLoadFactor(minLoad);
+  }
+
+  //*** Iterator Functionality
+
+  Iterator begin() {
+    return set_.begin();
+  }
+
+  Iterator end() {
+    return set_.end();
+  }
+};
+
+#endif      // FILTER_HASH_HPP_
@@ -0,0 +1,1074 @@
+#ifndef FLAT_HASH_HPP_
+#define FLAT_HASH_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bucket_policy.hpp"
+#include "hash_stats.hpp"
+#include "mapped_hash.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace hashset_detail {
+
+// A group is the window of control bytes that one probe step inspects.  Every
+// match function returns a bitmask with bit i set when byte i qualifies.
+#if defined(__AVX2__)
+
+inline constexpr std::size_t kGroupWidth = 32;
+
+struct Group {
+  __m256i ctrl;
+
+  explicit Group(const std::int8_t* p)
+      : ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) {}
+
+  std::uint32_t match(std::int8_t value) const {
+    return static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8(value))));
+  }
+
+  // empty and deleted are the only negative values below -1
+  std::uint32_t matchEmptyOrDeleted() const {
+    return static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(-1), ctrl)));
+  }
+};
+
+#elif defined(__SSE2__)
+
+inline constexpr std::size_t kGroupWidth = 16;
+
+struct Group {
+  __m128i ctrl;
+
+  explicit Group(const std::int8_t* p)
+      : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+
+  std::uint32_t match(std::int8_t value) const {
+    return static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value))));
+  }
+
+  // empty and deleted are the only negative values below -1
+  std::uint32_t matchEmptyOrDeleted() const {
+    return static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl)));
+  }
+};
+
+#else
+
+inline constexpr std::size_t kGroupWidth = 8;
+
+struct Group {
+  const std::int8_t* ctrl;
+
+  explicit Group(const std::int8_t* p) : ctrl(p) {}
+
+  std::uint32_t match(std::int8_t value) const {
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < kGroupWidth; ++i) {
+      mask |= static_cast<std::uint32_t>(ctrl[i] == value) << i;
+    }
+    return mask;
+  }
+
+  std::uint32_t matchEmptyOrDeleted() const {
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < kGroupWidth; ++i) {
+      mask |= static_cast<std::uint32_t>(ctrl[i] < -1) << i;
+    }
+    return mask;
+  }
+};
+
+#endif
+
+// position of the lowest set bit, the mask is never zero here
+inline std::size_t lowestBit(std::uint32_t mask) {
+  return static_cast<std::size_t>(__builtin_ctz(mask));
+}
+
+}  // namespace hashset_detail
+
+// Open-addressing backend.  Keys live in one contiguous slot array and every
+// slot has a control byte that is either empty, deleted, or a 7-bit tag taken
+// from the hash of the key.  Lookups compare a whole group of control bytes at
+// once (SSE2/AVX2 when available) and only touch a slot when its tag matches,
+// so a typical probe costs a single cache miss.  Keys must be default
+// constructible, since every slot holds one.
+template <typename Key, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<Key>,
+          typename BucketPolicy = PrimeModPolicy>
+class FlatHashSet {
+ private:
+  // the bucket counts come from the same policies as ChainedHashSet, so
+  // that both backends grow through identical sizes
+  static constexpr auto sizes = BucketPolicy::sizes;
+
+  // control byte states, a full slot stores its tag in 0..127
+  static constexpr std::int8_t kEmpty = -128;
+  static constexpr std::int8_t kDeleted = -2;
+
+  // open addressing needs free slots to terminate probes, so the effective
+  // load factor never goes above this regardless of maxLoadFactor()
+  static constexpr float kMaxFlatLoad = 0.875f;
+
+  // Number of keys whose memory accesses are overlapped by the batch functions.
+  static constexpr std::size_t kBatchBlock = 16;
+
+  static constexpr std::size_t kGroupWidth = hashset_detail::kGroupWidth;
+
+  using CtrlAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<std::int8_t>;
+
+  // ctrl has bucketCount() + group width bytes: the tail mirrors the head so
+  // that a group load starting near the end never has to wrap around
+  std::vector<std::int8_t, CtrlAllocator> ctrl;
+  std::vector<Key, Allocator> slots;
+  std::size_t size_;
+  std::size_t tombstones_;
+  float max_load_factor_;
+  float min_load_factor_;
+  [[no_unique_address]] Hash hash_;
+  [[no_unique_address]] KeyEqual equal_;
+  // maps hashes to home slots for the current bucket count
+  BucketPolicy policy_;
+  // health counters, empty unless built with HASHSET_STATS
+  [[no_unique_address]] hashset_detail::StatsCounters stats_;
+
+  std::int8_t tag(const Key& key) const;
+  void setCtrl(std::size_t idx, std::int8_t value);
+  float effectiveLoadFactor() const;
+  std::size_t wrap(std::size_t idx) const;
+  std::size_t findSlot(const Key& key) const;
+  // findSlot that also sets free to the slot insert would fill when key is
+  // absent: the first empty or deleted one the probe passed
+  std::size_t findSlot(const Key& key, std::size_t& free) const;
+  std::size_t findInsertSlot(std::size_t home) const;
+  void rebuild(std::size_t newSize);
+  // the bucket count shrink_to_fit() would pick, at most bucketCount()
+  std::size_t shrinkSize() const;
+  std::size_t nextFull(std::size_t idx) const;
+  // how many groups past the group at home the slot idx lies
+  std::size_t displacement(std::size_t home, std::size_t idx) const;
+
+ public:
+  class Iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = const Key&;
+
+    Iterator() = default;
+
+    reference operator*() const {
+      return set_->slots[idx_];
+    }
+
+    pointer operator->() const {
+      return &set_->slots[idx_];
+    }
+
+    Iterator& operator++() {
+      idx_ = set_->nextFull(idx_ + 1);
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    Iterator& operator--() {
+      do {
+        --idx_;
+      } while (set_->ctrl[idx_] < 0);
+      return *this;
+    }
+
+    Iterator operator--(int) {
+      Iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    friend bool operator==(const Iterator&, const Iterator&) = default;
+
+   private:
+    friend class FlatHashSet;
+    Iterator(const FlatHashSet* set, std::size_t idx) : set_(set), idx_(idx) {}
+
+    const FlatHashSet* set_ {nullptr};
+    std::size_t idx_ {0};
+  };
+
+  using key_type = Key;
+  using value_type = Key;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+  // keys are never written through an Iterator, so a const set hands out the
+  // same type
+  using const_iterator = Iterator;
+  // read-only view of a snapshot written by save()
+  using Mapped = MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>;
+
+  //*** Constructors, Destructor, Assignment
+
+  // default constuctor
+  FlatHashSet();
+
+  // constructor with explicit hasher, key comparison and allocator
+  explicit FlatHashSet(const Hash& hash, const KeyEqual& equal = KeyEqual(),
+                       const Allocator& alloc = Allocator());
+
+  // constructors from a range or a list of keys.  The bucket count is picked
+  // once up front when the number of keys is known.
+  template <std::input_iterator It>
+  FlatHashSet(It first, It last, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+              const Allocator& alloc = Allocator());
+
+  FlatHashSet(std::initializer_list<Key> keys, const Hash& hash = Hash(),
+              const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator());
+
+  // copy constructor
+  FlatHashSet(const FlatHashSet&);
+
+  // move constructor
+  FlatHashSet(FlatHashSet&&);
+
+  // assignment operator
+  FlatHashSet& operator=(FlatHashSet);
+
+  // exchange contents with other
+  void swap(FlatHashSet& other);
+
+  // destructor
+  ~FlatHashSet();
+
+  //*** Core Level 1 functionality
+
+  // returns the key's slot, and whether it was inserted.  One probe finds
+  // either the key or the slot for it, and only a new key can grow the table.
+  std::pair<Iterator, bool> insert(const Key& key);
+  std::pair<Iterator, bool> insert(Key&& key);
+
+  // returns hint at once if it holds key, and insert(key).first otherwise
+  Iterator insert(Iterator hint, const Key& key);
+
+  // inserts a key constructed from args
+  template <typename... Args>
+  std::pair<Iterator, bool> emplace(Args&&... args);
+
+  // insert every key of [first, last), growing the table at most once when
+  // the length of the range is known
+  template <std::input_iterator It>
+  void insert(It first, It last);
+
+  void insert(std::initializer_list<Key> keys);
+
+  bool contains(const Key& key) const;
+
+  // shrinks the table when the load factor falls below minLoadFactor()
+  void erase(const Key& key);
+
+  // increase number of buckets to at least newSize
+  // and rehash all elements into the new buckets
+  void rehash(std::size_t newSize);
+
+  // shrink to the fewest slots that keep the load factor at or below half of
+  // its limit and drop all tombstones.  Invalidates iterators.
+  void shrink_to_fit();
+
+  // make room for n elements in total, so that inserting them does not rehash
+  void reserve(std::size_t n);
+
+  // remove every element, keeping the bucket count
+  void clear();
+
+  //*** Snapshots
+
+  // writes the set to path in the layout described in mapped_hash.hpp,
+  // replacing any file there only once the new one is complete
+  void save(const std::string& path) const;
+
+  // maps a snapshot written by save() for read-only queries.  Nothing is
+  // rebuilt; see MappedHashSet for the checks made and the exceptions thrown.
+  static Mapped openMapped(const std::string& path, bool verify = true);
+
+  //*** Batched functionality
+
+  // sets bit i of out (word i / 64, bit i % 64) when keys[i] is present and
+  // returns the number of hits.  out must hold at least (keys.size() + 63) / 64
+  // words.  Keys are resolved in small blocks whose memory is prefetched up
+  // front, so the cache misses of a block overlap instead of queueing.
+  std::size_t containsBatch(std::span<const Key> keys,
+                            std::span<std::uint64_t> out) const;
+
+  // inserts every key.  The table grows only when a new key needs the room,
+  // so it ends up the same size as after inserting the keys one by one.
+  void insertBatch(std::span<const Key> keys);
+
+  // calls f(key) for the keys of a contiguous range of buckets, the part-th of
+  // parts such ranges.  The parts are disjoint and together hold every key, so
+  // several threads may each take a part as long as nobody modifies the set.
+  template <typename F>
+  void forEachInPart(std::size_t part, std::size_t parts, F f) const;
+
+  //*** Core Level 2 functionality
+
+  Iterator find(const Key& key) const;
+
+  // erasing leaves a tombstone, so iterators to other elements stay valid
+  Iterator erase(Iterator it);
+
+  //*** Utility functions
+
+  // return the number of elements
+  std::size_t size() const;
+
+  // return whether or not the hash set is empty
+  bool empty() const;
+
+  // return the number of buckets, i.e. the number of slots
+  std::size_t bucketCount() const;
+
+  // return the number of elements whose home slot is b
+  std::size_t bucketSize(std::size_t b) const;
+
+  // return the home slot of key
+  std::size_t bucket(const Key& key) const;
+
+  // return the load factor
+  float loadFactor() const;
+
+  // return the load factor threshold that provokes a rehash
+  float maxLoadFactor() const;
+
+  // set the load factor threshold
+  void maxLoadFactor(float maxLoad);
+
+  // return the load factor below which erase(key) calls shrink_to_fit(); 0,
+  // the default, never shrinks.  As with ChainedHashSet, values above a
+  // quarter of the load limit act as that quarter, and erase(Iterator) never
+  // shrinks.
+  float minLoadFactor() const;
+
+  // set the load factor that triggers shrinking; 0 turns it off
+  void minLoadFactor(float minLoad);
+
+  // return a copy of the allocator the slots are allocated with
+  Allocator get_allocator() const;
+
+  Hash hash_function() const;
+
+  KeyEqual key_eq() const;
+
+  // counters of lookups, probes, rehashes and displacements; see
+  // hash_stats.hpp.  All zero unless built with HASHSET_STATS.
+  HashSetStats stats() const;
+
+  // zero the lookup and rehash counters, e.g. at the start of an interval
+  void resetStats();
+
+  //*** Iterator Functionality
+
+  Iterator begin() const;
+
+  Iterator end() const;
+
+ private:
+  // the insert behind both reference overloads and emplace
+  template <typename K>
+  std::pair<Iterator, bool> insertKey(K&& key);
+};
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::begin() const -> Iterator {
+  return Iterator(this, nextFull(0));
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::end() const -> Iterator {
+  return Iterator(this, bucketCount());
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::FlatHashSet() : FlatHashSet(Hash()) {
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::FlatHashSet(
+    const Hash& hash, const KeyEqual& equal, const Allocator& alloc)
+    : ctrl(sizes[0] + kGroupWidth, kEmpty, CtrlAllocator(alloc)),
+      slots(sizes[0], alloc), size_(0), tombstones_(0), max_load_factor_(0.75f),
+      min_load_factor_(0.0f), hash_(hash), equal_(equal), policy_(sizes[0]) {
+}
+
+// Slots are plain values, so a copy is just the two arrays.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::FlatHashSet(const FlatHashSet& other)
+    : ctrl(other.ctrl), slots(other.slots), size_(other.size_),
+      tombstones_(other.tombstones_), max_load_factor_(other.max_load_factor_),
+      min_load_factor_(other.min_load_factor_), hash_(other.hash_), equal_(other.equal_), policy_(other.policy_), stats_(other.stats_) {
+}
+
+// The moved-from set is left empty but usable.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::FlatHashSet(FlatHashSet&& other)
+    : FlatHashSet(other.hash_, other.equal_, other.slots.get_allocator()) {
+  swap(other);
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+template <std::input_iterator It>
+FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::FlatHashSet(
+    It first, It last, const Hash& hash, const KeyEqual& equal, const Allocator& alloc)
+    : FlatHashSet(hash, equal, alloc) {
+  insert(first, last);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::FlatHashSet(
+    std::initializer_list<Key> keys, const Hash& hash, const KeyEqual& equal, const Allocator& alloc)
+    : FlatHashSet(keys.begin(), keys.end(), hash, equal, alloc) {
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::operator=(FlatHashSet other)
+    -> FlatHashSet& {
+  swap(other);
+  return *this;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::swap(FlatHashSet& other) {
+  std::swap(ctrl, other.ctrl);
+  std::swap(slots, other.slots);
+  std::swap(size_, other.size_);
+  std::swap(tombstones_, other.tombstones_);
+  std::swap(max_load_factor_, other.max_load_factor_);
+  std::swap(min_load_factor_, other.min_load_factor_);
+  std::swap(hash_, other.hash_);
+  std::swap(equal_, other.equal_);
+  std::swap(policy_, other.policy_);
+  std::swap(stats_, other.stats_);
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::~FlatHashSet() {
+}
+
+// The tag is the top 7 bits of the mixed hash.  The home slot is a
+// multiplicative hash of the bucket index (see bucket()), so keys that share
+// a group share the top bits of that product and the tag has to come from
+// somewhere else to tell them apart.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::int8_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::tag(const Key& key) const {
+  return static_cast<std::int8_t>(Pow2MixPolicy::mix(hash_(key)) >> 57);
+}
+
+// Writes the control byte and every mirror of it in the tail.  Small tables
+// are shorter than one group, so a byte can be mirrored more than once.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::setCtrl(std::size_t idx, std::int8_t value) {
+  std::size_t cap = bucketCount();
+  for (std::size_t i = idx; i < cap + kGroupWidth; i += cap) {
+    ctrl[i] = value;
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+float FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::effectiveLoadFactor() const {
+  return std::min(max_load_factor_, kMaxFlatLoad);
+}
+
+// Maps a position less than bucketCount() + kGroupWidth back into the table.
+// Only tables smaller than one group can need more than one subtraction.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::wrap(std::size_t idx) const {
+  std::size_t cap = bucketCount();
+  while (idx >= cap) {
+    idx -= cap;
+  }
+  return idx;
+}
+
+// Probes group by group from the home slot.  Keys are never placed past a
+// group that has an empty byte, so the first such group ends the search.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::findSlot(const Key& key) const {
+  std::size_t cap = bucketCount();
+  std::int8_t t = tag(key);
+  std::size_t pos = bucket(key);
+  std::size_t groups = 0;
+
+  for (std::size_t probed = 0; probed < cap; probed += kGroupWidth) {
+    hashset_detail::Group g(&ctrl[pos]);
+    groups++;
+    for (std::uint32_t m = g.match(t); m != 0; m &= m - 1) {
+      std::size_t idx = wrap(pos + hashset_detail::lowestBit(m));
+      if (equal_(slots[idx], key)) {
+        stats_.lookup(true, groups);
+        return idx;
+      }
+    }
+    if (g.match(kEmpty) != 0) {
+      break;
+    }
+    pos = wrap(pos + kGroupWidth);
+  }
+  stats_.lookup(false, groups);
+  return cap;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::findSlot(const Key& key,
+                                                                          std::size_t& free) const {
+  std::size_t cap = bucketCount();
+  std::int8_t t = tag(key);
+  std::size_t pos = bucket(key);
+  std::size_t groups = 0;
+  free = cap;
+
+  for (std::size_t probed = 0; probed < cap; probed += kGroupWidth) {
+    hashset_detail::Group g(&ctrl[pos]);
+    groups++;
+    for (std::uint32_t m = g.match(t); m != 0; m &= m - 1) {
+      std::size_t idx = wrap(pos + hashset_detail::lowestBit(m));
+      if (equal_(slots[idx], key)) {
+        stats_.lookup(true, groups);
+        return idx;
+      }
+    }
+    if (free == cap) {
+      if (std::uint32_t m = g.matchEmptyOrDeleted(); m != 0) {
+        free = wrap(pos + hashset_detail::lowestBit(m));
+      }
+    }
+    if (g.match(kEmpty) != 0) {
+      break;
+    }
+    pos = wrap(pos + kGroupWidth);
+  }
+  stats_.lookup(false, groups);
+  return cap;
+}
+
+// First empty or deleted slot on the probe sequence of home.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::findInsertSlot(std::size_t home) const {
+  std::size_t cap = bucketCount();
+  std::size_t pos = home;
+
+  for (std::size_t probed = 0; probed < cap; probed += kGroupWidth) {
+    std::uint32_t m = hashset_detail::Group(&ctrl[pos]).matchEmptyOrDeleted();
+    if (m != 0) {
+      return wrap(pos + hashset_detail::lowestBit(m));
+    }
+    pos = wrap(pos + kGroupWidth);
+  }
+  throw std::length_error("FlatHashSet: no free slot");
+}
+
+// Reinserts every key into fresh arrays of newSize slots, which also drops
+// all tombstones.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::rebuild(std::size_t newSize) {
+  stats_.rehashStarted();
+  [[maybe_unused]] auto timing = stats_.timeRehash();
+  stats_.lengthsCleared();
+  std::vector<std::int8_t, CtrlAllocator> oldCtrl(newSize + kGroupWidth, kEmpty,
+                                                  ctrl.get_allocator());
+  std::vector<Key, Allocator> oldSlots(newSize, slots.get_allocator());
+  std::swap(ctrl, oldCtrl);
+  std::swap(slots, oldSlots);
+  policy_ = BucketPolicy(newSize);
+
+  for (std::size_t i = 0; i < oldSlots.size(); ++i) {
+    if (oldCtrl[i] >= 0) {
+      std::size_t home = bucket(oldSlots[i]);
+      std::size_t idx = findInsertSlot(home);
+      setCtrl(idx, tag(oldSlots[i]));
+      slots[idx] = std::move(oldSlots[i]);
+      stats_.lengthAdded(displacement(home, idx));
+    }
+  }
+  tombstones_ = 0;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::displacement(
+    std::size_t home, std::size_t idx) const {
+  return ((idx >= home) ? idx - home : idx + bucketCount() - home) / kGroupWidth;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::nextFull(std::size_t idx) const {
+  std::size_t cap = bucketCount();
+  while (idx < cap && ctrl[idx] < 0) {
+    ++idx;
+  }
+  return idx;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::insert(const Key& key)
+    -> std::pair<Iterator, bool> {
+  return insertKey(key);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::insert(Key&& key)
+    -> std::pair<Iterator, bool> {
+  return insertKey(std::move(key));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::insert(Iterator hint, const Key& key)
+    -> Iterator {
+  if (hint != end() && equal_(*hint, key)) {
+    return hint;
+  }
+  return insert(key).first;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+template <typename... Args>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::emplace(Args&&... args)
+    -> std::pair<Iterator, bool> {
+  return insertKey(Key(std::forward<Args>(args)...));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+template <typename K>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::insertKey(K&& key)
+    -> std::pair<Iterator, bool> {
+  std::size_t idx;
+  std::size_t found = findSlot(key, idx);
+  if (found != bucketCount()) {
+    return {Iterator(this, found), false};
+  }
+
+// Tombstones occupy slots just like keys do, so they count towards the load.
+// While live keys stay under 25/32 of the limit, rebuilding at the same size
+// to drop the tombstones is enough and keeps churn from growing the table.
+// Either way the slot found by the probe is gone and is looked up again.
+  float limit = bucketCount() * effectiveLoadFactor();
+  if ((size_ + tombstones_ + 1) > limit) {
+    if (32 * (size_ + 1) <= 25 * limit) {
+      rebuild(bucketCount());
+    }
+    else {
+      rehash(growthTarget(bucketCount()));
+      if ((size_ + tombstones_ + 1) > bucketCount() * effectiveLoadFactor()) {
+        rebuild(bucketCount());
+      }
+    }
+    idx = bucketCount();
+  }
+  if (size_ + 1 >= bucketCount()) {
+    throw std::length_error("FlatHashSet: maximum bucket count reached");
+  }
+
+  std::size_t home = bucket(key);
+  if (idx == bucketCount()) {
+    idx = findInsertSlot(home);
+  }
+  if (ctrl[idx] == kDeleted) {
+    tombstones_--;
+  }
+  setCtrl(idx, tag(key));
+  slots[idx] = std::forward<K>(key);
+  size_++;
+  stats_.lengthAdded(displacement(home, idx));
+  return {Iterator(this, idx), true};
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+template <std::input_iterator It>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::insert(It first, It last) {
+  if constexpr (std::forward_iterator<It>) {
+    reserve(size_ + static_cast<std::size_t>(std::distance(first, last)));
+  }
+  for (; first != last; ++first) {
+    insert(*first);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::insert(std::initializer_list<Key> keys) {
+  insert(keys.begin(), keys.end());
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+bool FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::contains(const Key& key) const {
+  return findSlot(key) != bucketCount();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::find(const Key& key) const -> Iterator {
+  return Iterator(this, findSlot(key));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::erase(const Key& key) {
+  std::size_t idx = findSlot(key);
+  if (idx == bucketCount()) {
+    return;
+  }
+  erase(Iterator(this, idx));
+
+  if (loadFactor() < std::min(min_load_factor_, effectiveLoadFactor() / 4)) {
+    shrink_to_fit();
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::erase(Iterator it) -> Iterator {
+  if (it.idx_ >= bucketCount()) {
+    return end();
+  }
+
+  if constexpr (hashset_detail::kStatsEnabled) {
+    stats_.lengthRemoved(displacement(bucket(slots[it.idx_]), it.idx_));
+  }
+  setCtrl(it.idx_, kDeleted);
+  size_--;
+  tombstones_++;
+
+  return Iterator(this, nextFull(it.idx_ + 1));
+}
+
+// A probe touches the control group at the home slot and usually the slot
+// itself, so both are prefetched for the whole block before any key is resolved.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::containsBatch(
+    std::span<const Key> keys, std::span<std::uint64_t> out) const {
+  if (out.size() < (keys.size() + 63) / 64) {
+    throw std::invalid_argument("containsBatch: output bitmask too small");
+  }
+  std::fill(out.begin(), out.begin() + (keys.size() + 63) / 64, 0);
+
+  std::size_t hits = 0;
+
+  for (std::size_t start = 0; start < keys.size(); start += kBatchBlock) {
+    std::size_t n = std::min(kBatchBlock, keys.size() - start);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      std::size_t pos = bucket(keys[start + i]);
+      __builtin_prefetch(&ctrl[pos]);
+      __builtin_prefetch(&slots[pos]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      if (findSlot(keys[start + i]) != bucketCount()) {
+        out[(start + i) / 64] |= std::uint64_t {1} << ((start + i) % 64);
+        hits++;
+      }
+    }
+  }
+  return hits;
+}
+
+// Like ChainedHashSet::insertBatch, growing is left to insert() so that
+// duplicates in the batch do not size the table.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::insertBatch(std::span<const Key> keys) {
+  for (std::size_t start = 0; start < keys.size(); start += kBatchBlock) {
+    std::size_t n = std::min(kBatchBlock, keys.size() - start);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      std::size_t pos = bucket(keys[start + i]);
+      __builtin_prefetch(&ctrl[pos]);
+      __builtin_prefetch(&slots[pos]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      insert(keys[start + i]);
+    }
+  }
+}
+
+// A key's part is that of the slot it sits in, not of its home slot; either
+// way every key is in exactly one part.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+template <typename F>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::forEachInPart(
+    std::size_t part, std::size_t parts, F f) const {
+  std::size_t last = bucketCount() * (part + 1) / parts;
+  for (std::size_t i = nextFull(bucketCount() * part / parts); i < last; i = nextFull(i + 1)) {
+    f(slots[i]);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::rehash(std::size_t newSize) {
+  // Same size selection as the chained backend, but against the clamped
+  // load factor so that probes always find an empty slot.
+  std::size_t new_size_ = sizes[0];
+  for (std::size_t size : sizes) {
+    if (size >= newSize && (static_cast<float>(size_) / size <= effectiveLoadFactor() || size == sizes.back())) {
+      new_size_ = size;
+      break;
+    }
+  }
+
+  if (new_size_ <= bucketCount()) {
+    return;
+  }
+
+  rebuild(new_size_);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::shrinkSize() const {
+  for (std::size_t size : sizes) {
+    if (size >= bucketCount() || static_cast<float>(size_) / size <= effectiveLoadFactor() / 2) {
+      return std::min(size, bucketCount());
+    }
+  }
+  return bucketCount();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::shrink_to_fit() {
+  std::size_t new_size_ = shrinkSize();
+  if (new_size_ < bucketCount() || tombstones_ > 0) {
+    rebuild(new_size_);
+  }
+}
+
+// Tombstones are dropped by the rebuild, so only live keys need the room.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::reserve(std::size_t n) {
+  rehash(static_cast<std::size_t>(std::ceil(n / effectiveLoadFactor())) + 1);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::clear() {
+  std::fill(ctrl.begin(), ctrl.end(), kEmpty);
+  size_ = 0;
+  tombstones_ = 0;
+  stats_.lengthsCleared();
+}
+
+// Snapshots are shared with ChainedHashSet, so a key's bucket in the file
+// comes from the unmixed hash, the same way the chained backend picks it,
+// and not from its home slot here.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::save(const std::string& path) const {
+  hashset_detail::writeSnapshot<Key>(
+      path, bucketCount(), size_,
+      [this](auto f) {
+        for (std::size_t i = nextFull(0); i < bucketCount(); i = nextFull(i + 1)) {
+          f(slots[i]);
+        }
+      },
+      [this](const Key& key) { return policy_.index(hash_(key)); });
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+auto FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::openMapped(const std::string& path,
+                                                                          bool verify) -> Mapped {
+  return Mapped(path, verify);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::size() const {
+  return size_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+bool FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::empty() const {
+  return (size_ == 0);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::bucketCount() const {
+  return slots.size();
+}
+
+// Every key homed at b sits on b's probe sequence before the first group that
+// contains an empty byte, so only that stretch has to be scanned.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::bucketSize(std::size_t b) const {
+  std::size_t cap = bucketCount();
+  if (b >= cap) {
+    return 0;
+  }
+
+  std::size_t c = 0;
+  for (std::size_t start = 0; start < cap; start += kGroupWidth) {
+    bool sawEmpty = false;
+    for (std::size_t i = start; i < start + kGroupWidth && i < cap; ++i) {
+      std::size_t idx = (b + i) % cap;
+      if (ctrl[idx] == kEmpty) {
+        sawEmpty = true;
+      }
+      else if (ctrl[idx] >= 0 && bucket(slots[idx]) == b) {
+        c++;
+      }
+    }
+    if (sawEmpty) {
+      break;
+    }
+  }
+  return c;
+}
+
+// The bucket index is scattered over the table by Fibonacci hashing before
+// it is used as the home slot.  Probing is linear, and with an identity hash
+// such as std::hash<int> dense keys would otherwise take neighbouring slots
+// and fill one long run of full groups, which every miss landing in it would
+// have to walk to the end.  Multiples of the golden ratio leave the free
+// slots spread evenly between the keys instead, so a probe soon reaches a
+// group with an empty slot.  The scatter is not one-to-one: distinct indices
+// can share a home slot, as with any hash.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+std::size_t FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::bucket(const Key& key) const {
+  std::uint64_t spread = static_cast<std::uint64_t>(policy_.index(hash_(key))) *
+                         0x9E37'79B9'7F4A'7C15ull;
+  return static_cast<std::size_t>((static_cast<unsigned __int128>(spread) * bucketCount()) >> 64);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+float FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::loadFactor() const {
+  if (bucketCount() == 0) {
+    return 0.0f;
+  }
+  return (static_cast<float>(size()) / bucketCount());
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+float FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::maxLoadFactor() const {
+  return max_load_factor_;
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::maxLoadFactor(float maxLoad) {
+  max_load_factor_ = maxLoad;
+
+  if (loadFactor() > max_load_factor_) {
+    std::size_t reqBuckets = std::ceil(size_ / max_load_factor_);
+    rehash(reqBuckets);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+float FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::minLoadFactor() const {
+  return min_load_factor_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::minLoadFactor(float minLoad) {
+  min_load_factor_ = minLoad;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+Allocator FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::get_allocator() const {
+  return slots.get_allocator();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+Hash FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::hash_function() const {
+  return hash_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+KeyEqual FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::key_eq() const {
+  return equal_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+HashSetStats FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::stats() const {
+  return stats_.snapshot();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy>
+void FlatHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy>::resetStats() {
+  stats_.reset();
+}
+
+#endif      // FLAT_HASH_HPP_
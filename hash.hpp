@@ -1,64 +1,451 @@
 #ifndef HASH_HPP_
 #define HASH_HPP_
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include "bucket_policy.hpp"
+#include "hash_stats.hpp"
+#include "mapped_hash.hpp"
+#include "flat_hash.hpp"
+#include "node_pool.hpp"
 
-class HashSet {
+namespace hashset_detail {
+
+// Every probe coroutine of one instantiation has the same frame size, so
+// frames are recycled through a per-thread free list instead of hitting the
+// allocator per key.
+struct FramePool {
+  std::size_t blockSize = 0;
+  std::vector<void*> free;
+
+  ~FramePool() {
+    for (void* p : free) {
+      ::operator delete(p);
+    }
+  }
+};
+
+// A single lookup that suspends after each prefetch.  It starts eagerly, so
+// creating it already issues the prefetch of its bucket head.
+template <typename It>
+struct ProbeTask {
+  struct promise_type {
+    static inline thread_local FramePool framePool;
+
+    // empty when the key is not present
+    std::optional<It> result;
+
+    ProbeTask get_return_object() {
+      return ProbeTask {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_value(std::optional<It> it) { result = it; }
+    void unhandled_exception() { std::terminate(); }
+
+    static void* operator new(std::size_t n) {
+      if (n == framePool.blockSize && !framePool.free.empty()) {
+        void* p = framePool.free.back();
+        framePool.free.pop_back();
+        return p;
+      }
+      if (framePool.blockSize == 0) {
+        framePool.blockSize = n;
+      }
+      return ::operator new(n);
+    }
+
+    static void operator delete(void* p, std::size_t n) {
+      if (n == framePool.blockSize) {
+        framePool.free.push_back(p);
+      }
+      else {
+        ::operator delete(p);
+      }
+    }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+}  // namespace hashset_detail
+
+// Node layouts for ChainedHashSet.  With KeyNodes a node holds the key alone,
+// so walking a chain maps the hash of every node it passes to a bucket to
+// see where the chain ends, a division per node with PrimeModPolicy.
+// CachedBucketNodes also keeps the bucket the node is chained under, which
+// the walks compare instead, and which a rehash overwrites as it moves the
+// node.  The bucket is kept in 32 bits, which fit in the padding after an int
+// key; tables of more than 2^32 buckets fall back to computing it.
+struct KeyNodes {};
+struct CachedBucketNodes {};
+
+namespace hashset_detail {
+
+inline constexpr std::size_t kMaxCachedBuckets = std::size_t {1} << 32;
+
+template <typename Key>
+struct CachedBucketNode {
+  Key key;
+  std::uint32_t bucket;
+};
+
+// A block the size of a std::list node, which holds two links and the value.
+// Allocators that reserve room per block size, such as PoolAllocator, are
+// rebound to it so that the room goes to the pool the list takes nodes from.
+template <typename T>
+struct ListNodeBlock {
+  void* links[2];
+  T value;
+};
+
+// The iterator of a ChainedHashSet with CachedBucketNodes: a list iterator
+// that dereferences to the key of its node.  With a const Key and a list
+// const_iterator it is the read-only iterator, which the mutable one
+// converts to.
+template <typename Key, typename Link>
+class CachedBucketIterator {
  private:
-  // the number of buckets must be one of the
-  // values in sizes.  After 1, they are prime numbers
-  // to promote uniform hashing.  We won't test your solution
-  // with more than 1'000'000 elements
-  const std::vector<std::size_t> sizes {1ul, 13ul, 59ul, 127ul, 257ul, 541ul,
-    1'109ul, 2'357ul, 5'087ul, 10'273ul, 20'753ul, 42'043ul,
-    85'229ul, 172'933ul, 351'061ul, 712'697ul, 1'447'153ul, 2'938'679ul};
+  Link link_;
+
+ public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = std::remove_const_t<Key>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = Key*;
+  using reference = Key&;
+
+  CachedBucketIterator() = default;
+
+  explicit CachedBucketIterator(Link link) : link_(link) {}
+
+  template <typename OtherKey, typename OtherLink>
+    requires std::is_convertible_v<OtherLink, Link>
+  CachedBucketIterator(const CachedBucketIterator<OtherKey, OtherLink>& other)
+      : link_(other.base()) {}
 
-  
+  Link base() const {
+    return link_;
+  }
+
+  Key& operator*() const {
+    return link_->key;
+  }
+
+  Key* operator->() const {
+    return &link_->key;
+  }
+
+  CachedBucketIterator& operator++() {
+    ++link_;
+    return *this;
+  }
+
+  CachedBucketIterator operator++(int) {
+    return CachedBucketIterator(link_++);
+  }
+
+  CachedBucketIterator& operator--() {
+    --link_;
+    return *this;
+  }
+
+  CachedBucketIterator operator--(int) {
+    return CachedBucketIterator(link_--);
+  }
+
+  friend bool operator==(const CachedBucketIterator&, const CachedBucketIterator&) = default;
+};
+
+}  // namespace hashset_detail
+
+template <typename Key, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<Key>,
+          typename BucketPolicy = PrimeModPolicy,
+          typename NodeLayout = KeyNodes>
+class ChainedHashSet {
+ private:
+  // the number of buckets must be one of the values in sizes.  With the
+  // default policy, after 1 they are prime numbers to promote uniform hashing
+  static constexpr auto sizes = BucketPolicy::sizes;
+
+  // Number of keys whose memory accesses are overlapped by the batch functions.
+  // Large enough to cover memory latency, small enough that the prefetched lines
+  // are still in L1 when the block is resolved.
+  static constexpr std::size_t kBatchBlock = 16;
+
+  // Work done by one step of an incremental rehash: old buckets are migrated
+  // whole until this many nodes have moved or this many buckets were visited.
+  static constexpr std::size_t kMigrateNodes = 16;
+  static constexpr std::size_t kMigrateBuckets = 64;
+
+  static constexpr bool kCachedBucket = std::is_same_v<NodeLayout, CachedBucketNodes>;
+  static_assert(kCachedBucket || std::is_same_v<NodeLayout, KeyNodes>,
+                "NodeLayout must be KeyNodes or CachedBucketNodes");
+
+  using Node = std::conditional_t<kCachedBucket, hashset_detail::CachedBucketNode<Key>, Key>;
+  using List = std::list<Node, typename std::allocator_traits<Allocator>::template rebind_alloc<Node>>;
+  // a position in elements
+  using Link = typename List::iterator;
+  using ConstLink = typename List::const_iterator;
+
+ public:
+  // we include this line to ensure compilation with the level 2 signatures
+  // you can change the way Iterator is implemented if you want
+  using Iterator = std::conditional_t<kCachedBucket,
+                                      hashset_detail::CachedBucketIterator<Key, Link>, Link>;
+  // the iterator of a const set; an Iterator converts to it
+  using const_iterator =
+      std::conditional_t<kCachedBucket,
+                         hashset_detail::CachedBucketIterator<const Key, ConstLink>, ConstLink>;
+
+ private:
+  using BucketAllocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Link>;
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<
+      hashset_detail::ListNodeBlock<Node>>;
 
   // define the member variables you need for your solution here
 
-  std::list<int> elements;
-  std::vector<std::list<int>::iterator> buckets;
+  List elements;
+  std::vector<Link, BucketAllocator> buckets;
   std::size_t size_;
   float max_load_factor_;
-  //std::vector<std::list<int>> newBuckets(size_t new_size_);
+  float min_load_factor_;
+  [[no_unique_address]] Hash hash_;
+  [[no_unique_address]] KeyEqual equal_;
+  // maps hashes to buckets for the current bucket count
+  BucketPolicy policy_;
+
+  // While an incremental rehash runs, oldBuckets is non-empty.  Old buckets
+  // below migrated_ have been moved into buckets, the others are still reached
+  // through oldBuckets and oldPolicy_.  Migrated nodes sit at the front of
+  // elements and unmigrated ones from boundary_ on, so chains never mix.
+  bool incremental_;
+  std::vector<Link, BucketAllocator> oldBuckets;
+  BucketPolicy oldPolicy_;
+  std::size_t migrated_;
+  Link boundary_;
+
+  // health counters, empty unless built with HASHSET_STATS
+  [[no_unique_address]] hashset_detail::StatsCounters stats_;
+
+  static const Key& keyOf(const Node& node);
+
+  // the bucket node is chained under.  While rehashing, only for nodes from
+  // boundary_ on does oldBucketOf() give their bucket in oldBuckets.
+  std::size_t bucketOf(Link node) const;
+  std::size_t oldBucketOf(Link node) const;
+
+  // records that node is now chained under bucket b
+  static void setBucketOf(Link node, std::size_t b);
+
+  // a new node for key in bucket b, placed before position
+  template <typename K>
+  Link insertNode(Link position, K&& key, std::size_t b);
+
+  static Iterator iteratorOf(Link node);
+  static Link linkOf(Iterator it);
+
+  // the bucket count rehash(newSize) would pick
+  std::size_t growSize(std::size_t newSize) const;
+
+  // rebuilds the bucket array with newSize buckets in one pass
+  void relink(std::size_t newSize);
+
+  // relink, counted in the stats
+  void rebuildBuckets(std::size_t newSize);
+
+  // the bucket count shrink_to_fit() would pick, at most bucketCount()
+  std::size_t shrinkSize() const;
+
+  // rehash for insert: incremental or not, depending on the mode
+  void grow(std::size_t newSize);
+
+  // moves a bounded number of old buckets into the new array
+  void migrateStep();
+
+  // rebuilds the chain-length histogram of the stats from the list
+  void recountChains();
+
+  // the node holding key while rehashing, if any
+  std::optional<Link> findMigrating(const Key& key) const;
+
+  // the node holding key, if any, whether or not a rehash is running
+  std::optional<Link> findLink(const Key& key) const;
+
+  // links key, which is not in the set, while rehashing
+  template <typename K>
+  Link insertMigrating(K&& key);
+
+  // runs the interleaved probes and hands (key index, result) to sink
+  template <typename Sink>
+  void probeInterleaved(std::span<const Key> keys, std::size_t groupSize,
+                        Sink sink) const;
 
  public:
-  // we include this line to ensure compilation with the level 2 signatures
-  // you can change the way Iterator is implemented if you want
-  using Iterator = std::list<int>::iterator;
-  
+  using key_type = Key;
+  using value_type = Key;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+  // read-only view of a snapshot written by save()
+  using Mapped = MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>;
 
   //*** Constructors, Destructor, Assignment
 
   // default constuctor
-  HashSet();
+  ChainedHashSet();
+
+  // constructor with explicit hasher, key comparison and allocator
+  explicit ChainedHashSet(const Hash& hash, const KeyEqual& equal = KeyEqual(),
+                          const Allocator& alloc = Allocator());
+
+  // constructors from a range or a list of keys.  The bucket count is picked
+  // once up front when the number of keys is known.
+  template <std::input_iterator It>
+  ChainedHashSet(It first, It last, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+                 const Allocator& alloc = Allocator());
 
-  // copy constructor
-  HashSet(const HashSet&);
+  ChainedHashSet(std::initializer_list<Key> keys, const Hash& hash = Hash(),
+                 const KeyEqual& equal = KeyEqual(), const Allocator& alloc = Allocator());
+
+  // copy constructor, linear in the number of elements
+  ChainedHashSet(const ChainedHashSet&);
+
+  // move constructor
+  ChainedHashSet(ChainedHashSet&&);
 
   // assignment operator
-  HashSet& operator=(HashSet);
+  ChainedHashSet& operator=(ChainedHashSet);
+
+  // exchange contents with other; iterators stay valid and follow their elements
+  void swap(ChainedHashSet& other);
 
   // destructor
-  ~HashSet();
+  ~ChainedHashSet();
 
   //*** Core Level 1 functionality
 
-  void insert(int key);
+  // returns the key's node, and whether it was inserted.  One walk of the
+  // chain finds either the key or the place for it, and only a new key can
+  // grow the table.
+  std::pair<Iterator, bool> insert(const Key& key);
+  std::pair<Iterator, bool> insert(Key&& key);
+
+  // returns hint at once if it holds key, and insert(key).first otherwise
+  Iterator insert(Iterator hint, const Key& key);
 
-  bool contains(int key) const;
+  // inserts a key constructed from args
+  template <typename... Args>
+  std::pair<Iterator, bool> emplace(Args&&... args);
 
-  void erase(int key);
+  // insert every key of [first, last), growing the table at most once when
+  // the length of the range is known
+  template <std::input_iterator It>
+  void insert(It first, It last);
+
+  void insert(std::initializer_list<Key> keys);
+
+  bool contains(const Key& key) const;
+
+  // shrinks the table when the load factor falls below minLoadFactor()
+  void erase(const Key& key);
 
   // increase number of buckets to at least newSize
   // and rehash all elements into the new buckets
   void rehash(std::size_t newSize);
 
+  // shrink to the fewest buckets that keep the load factor at or below half
+  // of maxLoadFactor(), so that the table can take as many keys again before
+  // it grows.  Iterators stay valid but the iteration order changes.
+  void shrink_to_fit();
+
+  // In incremental mode a growing insert only allocates the new bucket array.
+  // Each later insert or erase(key) then migrates a few old buckets, and
+  // lookups consult the old array for keys that have not moved yet.  This
+  // bounds the work of any single insert.  rehash() and switching the mode
+  // off still complete any pending migration at once.
+  void incrementalRehash(bool on);
+
+  bool incrementalRehash() const;
+
+  // return whether an incremental rehash is in progress
+  bool rehashing() const;
+
+  // make room for n elements in total, so that inserting them does not rehash
+  void reserve(std::size_t n);
+
+  // remove every element, keeping the bucket count.  The nodes go back to the
+  // allocator, which for PoolAllocator keeps them for reuse; call
+  // get_allocator().resource()->release() afterwards to free its slabs too.
+  void clear();
+
+  //*** Snapshots
+
+  // writes the set to path in the layout described in mapped_hash.hpp,
+  // replacing any file there only once the new one is complete
+  void save(const std::string& path) const;
+
+  // maps a snapshot written by save() for read-only queries.  Nothing is
+  // rebuilt; see MappedHashSet for the checks made and the exceptions thrown.
+  static Mapped openMapped(const std::string& path, bool verify = true);
+
+  //*** Batched functionality
+
+  // sets bit i of out (word i / 64, bit i % 64) when keys[i] is present and
+  // returns the number of hits.  out must hold at least (keys.size() + 63) / 64
+  // words.  Keys are resolved in small blocks whose memory is prefetched up
+  // front, so the cache misses of a block overlap instead of queueing.
+  std::size_t containsBatch(std::span<const Key> keys,
+                            std::span<std::uint64_t> out) const;
+
+  // inserts every key.  The table grows only when a new key needs the room,
+  // so it ends up the same size as after inserting the keys one by one.
+  void insertBatch(std::span<const Key> keys);
+
+  // calls f(key) for the keys of a contiguous range of buckets, the part-th of
+  // parts such ranges.  The parts are disjoint and together hold every key, so
+  // several threads may each take a part as long as nobody modifies the set.
+  template <typename F>
+  void forEachInPart(std::size_t part, std::size_t parts, F f) const;
+
+  // same result as containsBatch, but every key is probed by a coroutine that
+  // prefetches the next chain node and suspends instead of waiting for it.
+  // Up to groupSize probes are in flight and resumed round-robin, so long
+  // chains in sets larger than the cache keep several misses outstanding.
+  std::size_t containsInterleaved(std::span<const Key> keys,
+                                  std::span<std::uint64_t> out,
+                                  std::size_t groupSize = 8) const;
+
+  // stores find(keys[i]) into out[i] using the same interleaved probes
+  void findInterleaved(std::span<const Key> keys, std::span<Iterator> out,
+                       std::size_t groupSize = 8);
+
   //*** Core Level 2 functionality
 
-  Iterator find(int key);
+  Iterator find(const Key& key);
+
+  // find for read-only access, e.g. through a const reference to the set
+  const_iterator find(const Key& key) const;
 
   Iterator erase(Iterator it);
 
@@ -73,11 +460,12 @@ class HashSet {
   // return the number of buckets, i.e. the size of the underlying array
   std::size_t bucketCount() const;
 
-  // return the number of elements in the bucket b
+  // return the number of elements in the bucket b.  While rehashing, elements
+  // not yet migrated are not counted
   std::size_t bucketSize(std::size_t b) const;
 
   // return which bucket key would go in
-  std::size_t bucket(int key) const;
+  std::size_t bucket(const Key& key) const;
 
   // return the load factor
   float loadFactor() const;
@@ -88,11 +476,1235 @@ class HashSet {
   // set the load factor threshold
   void maxLoadFactor(float maxLoad);
 
+  // return the load factor below which erase(key) calls shrink_to_fit().  It
+  // is 0 by default, so tables never shrink on their own.  Values above a
+  // quarter of maxLoadFactor() act as that quarter: a grown table is always
+  // fuller than that, and a shrunk one is never fuller than half, so a table
+  // cannot bounce between two sizes.  erase(Iterator) never shrinks, so that
+  // loops erasing while iterating keep working.
+  float minLoadFactor() const;
+
+  // set the load factor that triggers shrinking; 0 turns it off
+  void minLoadFactor(float minLoad);
+
+  // return a copy of the allocator the elements are allocated with
+  Allocator get_allocator() const;
+
+  Hash hash_function() const;
+
+  KeyEqual key_eq() const;
+
+  // counters of lookups, probes, rehashes and chain lengths; see
+  // hash_stats.hpp.  All zero unless built with HASHSET_STATS.
+  HashSetStats stats() const;
+
+  // zero the lookup and rehash counters, e.g. at the start of an interval
+  void resetStats();
+
   //*** Iterator Functionality
 
   Iterator begin();
 
   Iterator end();
+
+  const_iterator begin() const;
+
+  const_iterator end() const;
+
+ private:
+  // the insert behind both reference overloads and emplace
+  template <typename K>
+  std::pair<Iterator, bool> insertKey(K&& key);
 };
 
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::begin() -> Iterator {
+  return iteratorOf(elements.begin());
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::end() -> Iterator {
+  return iteratorOf(elements.end());
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::begin() const
+    -> const_iterator {
+  return const_iterator(elements.begin());
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::end() const
+    -> const_iterator {
+  return const_iterator(elements.end());
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::ChainedHashSet()
+    : ChainedHashSet(Hash()) {
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::ChainedHashSet(
+    const Hash& hash, const KeyEqual& equal, const Allocator& alloc)
+    : elements(alloc), buckets(BucketAllocator(alloc)), size_(0),
+      max_load_factor_(0.75f), min_load_factor_(0.0f), hash_(hash), equal_(equal), policy_(sizes[0]),
+      incremental_(false), oldBuckets(BucketAllocator(alloc)), oldPolicy_(sizes[0]),
+      migrated_(0), boundary_(elements.end()) {
+  buckets.resize(sizes[0], elements.end());
+  stats_.lengthAdded(0, sizes[0]);
+}
+
+// The copy constructor creates a new HashSet that's a deep copy of the original
+// The idea is generally not only to copy the elements but also preserve the bucket-to-element mapping.
+// This is done in a single pass: each node is appended to the copy, and if the
+// original node heads its bucket (or is the migration boundary), the matching
+// slot of the copy is pointed at the new node.  Finding a node's bucket costs a
+// hash, or nothing with CachedBucketNodes, rather than a walk of the list.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::ChainedHashSet(const ChainedHashSet& other)
+    : elements(std::allocator_traits<typename List::allocator_type>::
+                   select_on_container_copy_construction(other.elements.get_allocator())),
+      buckets(other.bucketCount(), elements.end(), BucketAllocator(elements.get_allocator())),
+      size_(other.size_), max_load_factor_(other.max_load_factor_),
+      min_load_factor_(other.min_load_factor_),
+      hash_(other.hash_), equal_(other.equal_), policy_(other.policy_),
+      incremental_(other.incremental_),
+      oldBuckets(other.oldBuckets.size(), elements.end(), BucketAllocator(elements.get_allocator())),
+      oldPolicy_(other.oldPolicy_), migrated_(other.migrated_), boundary_(elements.end()),
+      stats_(other.stats_) {
+
+// Allocators that can hand out many nodes at once, such as PoolAllocator, are
+// asked to do so.
+  NodeAllocator alloc(elements.get_allocator());
+  if constexpr (requires { alloc.reserve(size_); }) {
+    alloc.reserve(size_);
+  }
+
+  bool migrating = other.rehashing();
+  bool unmigrated = false;
+  for (auto pos = other.elements.begin(); pos != other.elements.end(); ++pos) {
+    Link copy = elements.insert(elements.end(), *pos);
+    if (migrating && other.boundary_ == pos) {
+      boundary_ = copy;
+      unmigrated = true;
+    }
+
+    if (unmigrated) {
+      std::size_t old = oldBucketOf(copy);
+      if (other.oldBuckets[old] == pos) {
+        oldBuckets[old] = copy;
+      }
+    }
+    else {
+      std::size_t idx = bucketOf(copy);
+      if (other.buckets[idx] == pos) {
+        buckets[idx] = copy;
+      }
+    }
+  }
+}
+
+// The moved-from set is left empty but usable.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::ChainedHashSet(ChainedHashSet&& other)
+    : ChainedHashSet(other.hash_, other.equal_, other.elements.get_allocator()) {
+  swap(other);
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <std::input_iterator It>
+ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::ChainedHashSet(
+    It first, It last, const Hash& hash, const KeyEqual& equal, const Allocator& alloc)
+    : ChainedHashSet(hash, equal, alloc) {
+  insert(first, last);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::ChainedHashSet(
+    std::initializer_list<Key> keys, const Hash& hash, const KeyEqual& equal, const Allocator& alloc)
+    : ChainedHashSet(keys.begin(), keys.end(), hash, equal, alloc) {
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::operator=(ChainedHashSet other)
+    -> ChainedHashSet& {
+  swap(other);
+  return *this;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::swap(ChainedHashSet& other) {
+  elements.swap(other.elements);
+  std::swap(buckets, other.buckets);
+  std::swap(size_, other.size_);
+  std::swap(max_load_factor_, other.max_load_factor_);
+  std::swap(min_load_factor_, other.min_load_factor_);
+  std::swap(hash_, other.hash_);
+  std::swap(equal_, other.equal_);
+  std::swap(policy_, other.policy_);
+  std::swap(incremental_, other.incremental_);
+  std::swap(oldBuckets, other.oldBuckets);
+  std::swap(oldPolicy_, other.oldPolicy_);
+  std::swap(migrated_, other.migrated_);
+  std::swap(boundary_, other.boundary_);
+  std::swap(stats_, other.stats_);
+
+// Swapping lists leaves each end() sentinel with its own object, so the empty
+// buckets of both sets still point at the other one's end() and are redirected.
+  auto redirect = [](ChainedHashSet& to, const ChainedHashSet& from) {
+    for (Link& b : to.buckets) {
+      if (b == from.elements.end()) {
+        b = to.elements.end();
+      }
+    }
+    for (Link& b : to.oldBuckets) {
+      if (b == from.elements.end()) {
+        b = to.elements.end();
+      }
+    }
+    if (to.boundary_ == from.elements.end()) {
+      to.boundary_ = to.elements.end();
+    }
+  };
+  redirect(*this, other);
+  redirect(other, *this);
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::~ChainedHashSet() {
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insert(const Key& key)
+    -> std::pair<Iterator, bool> {
+  return insertKey(key);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insert(Key&& key)
+    -> std::pair<Iterator, bool> {
+  return insertKey(std::move(key));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insert(Iterator hint,
+                                                                                     const Key& key)
+    -> Iterator {
+  if (hint != end() && equal_(*hint, key)) {
+    return hint;
+  }
+  return insert(key).first;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <typename... Args>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::emplace(Args&&... args)
+    -> std::pair<Iterator, bool> {
+  return insertKey(Key(std::forward<Args>(args)...));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <typename K>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insertKey(K&& key)
+    -> std::pair<Iterator, bool> {
+
+  if (rehashing()) {
+    migrateStep();
+  }
+
+  std::size_t idx = 0;
+  std::size_t length = 0;
+  Link insertPosition = elements.end();
+
+  if (rehashing()) {
+    if (std::optional<Link> found = findMigrating(key)) {
+      return {iteratorOf(*found), false};
+    }
+  }
+  else {
+// The walk that looks for the key ends on the node after its chain.  Elements
+// of one bucket must be contiguous in the list, so that is where a new node
+// goes.  An empty bucket leaves it at the end of the list, which is always
+// between two chains (relink() does not keep the chains in bucket order).
+    idx = bucket(key);
+    for (insertPosition = buckets[idx];
+         insertPosition != elements.end() && bucketOf(insertPosition) == idx; ++insertPosition) {
+      length++;
+      if (equal_(keyOf(*insertPosition), key)) {
+        stats_.lookup(true, length);
+        return {iteratorOf(insertPosition), false};
+      }
+    }
+    stats_.lookup(false, length);
+  }
+
+// Checks if rehashing is needed before insertion.  A rehash moves the chains,
+// so the end of the key's chain is looked for again.
+  if ((size_ + 1) > bucketCount() * maxLoadFactor()) {
+    grow(growthTarget(bucketCount()));
+    if (!rehashing()) {
+      idx = bucket(key);
+      length = 0;
+      for (insertPosition = buckets[idx];
+           insertPosition != elements.end() && bucketOf(insertPosition) == idx; ++insertPosition) {
+        length++;
+      }
+    }
+  }
+
+  if (rehashing()) {
+    return {iteratorOf(insertMigrating(std::forward<K>(key))), true};
+  }
+
+// Actual insertion is performed here. Yep, neat right?
+  Link new_elem = insertNode(insertPosition, std::forward<K>(key), idx);
+
+  if (buckets[idx] == elements.end()) {
+    buckets[idx] = new_elem;
+  }
+
+  size_++;
+  stats_.lengthMoved(length, length + 1);
+  return {iteratorOf(new_elem), true};
+}
+
+
+// Duplicates in the range are counted too, so the table may end up larger than
+// needed, but never has to grow while the range is inserted.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <std::input_iterator It>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insert(It first, It last) {
+  if constexpr (std::forward_iterator<It>) {
+    reserve(size_ + static_cast<std::size_t>(std::distance(first, last)));
+  }
+  for (; first != last; ++first) {
+    insert(*first);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insert(std::initializer_list<Key> keys) {
+  insert(keys.begin(), keys.end());
+}
+
+
+// The main concept here is to return true if the key exists in the HashSet. It uses
+// the hash to locate the corresponding bucket and search through it.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+bool ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::contains(const Key& key) const {
+  return findLink(key).has_value();
+}
+
+// The key idea here is to return an iterator to the key if found, otherwise just to return
+// elements.end(). It efficiently searches only within the relevant bucket using hashing.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::find(const Key& key) -> Iterator {
+  return iteratorOf(findLink(key).value_or(elements.end()));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::find(const Key& key) const
+    -> const_iterator {
+  std::optional<Link> found = findLink(key);
+  return found ? const_iterator(ConstLink(*found)) : end();
+}
+
+// Searches only the bucket of key.  The buckets hold mutable list iterators,
+// so the node found can be handed out by find() as well as checked by
+// contains().
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::findLink(const Key& key) const
+    -> std::optional<Link> {
+  if (rehashing()) {
+    return findMigrating(key);
+  }
+
+  std::size_t idx = bucket(key);
+
+  if (buckets[idx] == elements.end()) {
+    stats_.lookup(false, 0);
+    return std::nullopt;
+  }
+
+  std::size_t probes = 0;
+  for (Link it = buckets[idx]; it != elements.end() && bucketOf(it) == idx; ++it) {
+    probes++;
+    if (equal_(keyOf(*it), key)) {
+      stats_.lookup(true, probes);
+      return it;
+    }
+  }
+  stats_.lookup(false, probes);
+  return std::nullopt;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::erase(const Key& key) {
+  if (rehashing()) {
+    migrateStep();
+  }
+
+  Iterator it = find(key);
+  if (it == end()) {
+    return;
+  }
+  erase(it);
+
+  if (loadFactor() < std::min(min_load_factor_, max_load_factor_ / 4)) {
+    shrink_to_fit();
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::erase(Iterator pos) -> Iterator {
+  Link it = linkOf(pos);
+  if (it == elements.end()) {
+    return pos;
+  }
+
+  Link next = std::next(it);
+
+// erase(it) never migrates: moving nodes would break loops that erase while
+// iterating.  A node that has not been migrated is unlinked from its old chain.
+  if (rehashing()) {
+    std::size_t old = oldPolicy_.index(hash_(keyOf(*it)));
+    if (old >= migrated_) {
+      if (oldBuckets[old] == it) {
+        oldBuckets[old] = (next != elements.end() && oldBucketOf(next) == old)
+                              ? next : elements.end();
+      }
+      if (boundary_ == it) {
+        boundary_ = next;
+      }
+      size_--;
+      return iteratorOf(elements.erase(it));
+    }
+  }
+
+  std::size_t idx = bucketOf(it);
+  Link chainEnd = rehashing() ? boundary_ : elements.end();
+
+  if constexpr (hashset_detail::kStatsEnabled) {
+    if (!rehashing()) {
+      std::size_t length = bucketSize(idx);
+      stats_.lengthMoved(length, length - 1);
+    }
+  }
+
+// If the element that the bucket points to is being erased, the pointer must be updated.
+  if (buckets[idx] == it) {
+
+    if (next != chainEnd && bucketOf(next) == idx) {
+// If there are more elements with the same hash, just point to the next one.
+      buckets[idx] = next;
+
+    }
+    else {
+      // Otherwise just mark the bucket as empty.
+      buckets[idx] = elements.end();
+    }
+  }
+
+// Actual erasure is performed and size is accordingly updated.
+  Link result = elements.erase(it);
+  size_--;
+
+  return iteratorOf(result);
+}
+
+// Each block runs in three passes: compute the bucket indices and prefetch the
+// bucket heads, prefetch the first chain node of every non-empty bucket, then
+// walk the chains, which by now are mostly in cache.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::containsBatch(
+    std::span<const Key> keys, std::span<std::uint64_t> out) const {
+  if (out.size() < (keys.size() + 63) / 64) {
+    throw std::invalid_argument("containsBatch: output bitmask too small");
+  }
+  std::fill(out.begin(), out.begin() + (keys.size() + 63) / 64, 0);
+
+  std::size_t hits = 0;
+  std::size_t idx[kBatchBlock];
+
+  if (rehashing()) {
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      if (contains(keys[i])) {
+        out[i / 64] |= std::uint64_t {1} << (i % 64);
+        hits++;
+      }
+    }
+    return hits;
+  }
+
+  for (std::size_t start = 0; start < keys.size(); start += kBatchBlock) {
+    std::size_t n = std::min(kBatchBlock, keys.size() - start);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      idx[i] = bucket(keys[start + i]);
+      __builtin_prefetch(&buckets[idx[i]]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      if (buckets[idx[i]] != elements.end()) {
+        __builtin_prefetch(&*buckets[idx[i]]);
+      }
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      const Key& key = keys[start + i];
+      std::size_t probes = 0;
+      bool hit = false;
+      auto it = buckets[idx[i]];
+      while (it != elements.end() && bucketOf(it) == idx[i]) {
+        probes++;
+        if (equal_(keyOf(*it), key)) {
+          out[(start + i) / 64] |= std::uint64_t {1} << ((start + i) % 64);
+          hits++;
+          hit = true;
+          break;
+        }
+        ++it;
+      }
+      stats_.lookup(hit, probes);
+    }
+  }
+  return hits;
+}
+
+// Growing is left to insert(), since how many keys of a block are new is only
+// known once they go in; growing for the whole block up front would size the
+// table for duplicates too.  When a block does grow the table, the buckets
+// prefetched for the rest of it are wasted, which happens once per doubling.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insertBatch(std::span<const Key> keys) {
+  std::size_t idx[kBatchBlock];
+
+  for (std::size_t start = 0; start < keys.size(); start += kBatchBlock) {
+    std::size_t n = std::min(kBatchBlock, keys.size() - start);
+
+    for (std::size_t i = 0; i < n; ++i) {
+      idx[i] = bucket(keys[start + i]);
+      __builtin_prefetch(&buckets[idx[i]]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      if (buckets[idx[i]] != elements.end()) {
+        __builtin_prefetch(&*buckets[idx[i]]);
+      }
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      insert(keys[start + i]);
+    }
+  }
+}
+
+// While rehashing, the part also takes the same share of the old buckets that
+// are not migrated yet.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <typename F>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::forEachInPart(
+    std::size_t part, std::size_t parts, F f) const {
+  std::size_t first = bucketCount() * part / parts;
+  std::size_t last = bucketCount() * (part + 1) / parts;
+  for (std::size_t idx = first; idx < last; ++idx) {
+    for (auto it = buckets[idx]; it != elements.end() && it != boundary_ && bucketOf(it) == idx; ++it) {
+      f(keyOf(*it));
+    }
+  }
+  if (!rehashing()) {
+    return;
+  }
+
+  first = std::max(migrated_, oldBuckets.size() * part / parts);
+  last = oldBuckets.size() * (part + 1) / parts;
+  for (std::size_t old = first; old < last; ++old) {
+    for (auto it = oldBuckets[old]; it != elements.end() && oldBucketOf(it) == old; ++it) {
+      f(keyOf(*it));
+    }
+  }
+}
+
+// A fixed number of probe coroutines share the core: each one runs until it
+// has issued a prefetch, then the next one gets its turn.  By the time a probe
+// is resumed its node has usually arrived.  A finished probe frees its place
+// for the next key.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <typename Sink>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::probeInterleaved(
+    std::span<const Key> keys, std::size_t groupSize, Sink sink) const {
+  using Task = hashset_detail::ProbeTask<Link>;
+
+  if (rehashing()) {
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      sink(i, findMigrating(keys[i]));
+    }
+    return;
+  }
+
+  // the key is taken by value so that it lives in the coroutine frame
+  auto probe = [](const ChainedHashSet* set, Key key) -> Task {
+    std::size_t idx = set->bucket(key);
+    __builtin_prefetch(&set->buckets[idx]);
+    co_await std::suspend_always {};
+
+    Link it = set->buckets[idx];
+    auto end = set->elements.end();
+    if (it == end) {
+      co_return std::nullopt;
+    }
+    __builtin_prefetch(&*it);
+    co_await std::suspend_always {};
+
+    while (it != end && set->bucketOf(it) == idx) {
+      if (set->equal_(keyOf(*it), key)) {
+        co_return it;
+      }
+      ++it;
+      if (it != end) {
+        __builtin_prefetch(&*it);
+        co_await std::suspend_always {};
+      }
+    }
+    co_return std::nullopt;
+  };
+
+  groupSize = std::max<std::size_t>(groupSize, 1);
+  std::vector<std::coroutine_handle<typename Task::promise_type>> inflight(groupSize);
+  std::vector<std::size_t> keyIdx(groupSize);
+  std::size_t next = 0;
+  std::size_t active = 0;
+
+  for (std::size_t s = 0; s < groupSize && next < keys.size(); ++s) {
+    inflight[s] = probe(this, keys[next]).handle;
+    keyIdx[s] = next++;
+    active++;
+  }
+
+  while (active > 0) {
+    for (std::size_t s = 0; s < groupSize; ++s) {
+      auto h = inflight[s];
+      if (!h) {
+        continue;
+      }
+      h.resume();
+      if (h.done()) {
+        sink(keyIdx[s], h.promise().result);
+        h.destroy();
+        if (next < keys.size()) {
+          inflight[s] = probe(this, keys[next]).handle;
+          keyIdx[s] = next++;
+        }
+        else {
+          inflight[s] = nullptr;
+          active--;
+        }
+      }
+    }
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::containsInterleaved(
+    std::span<const Key> keys, std::span<std::uint64_t> out, std::size_t groupSize) const {
+  if (out.size() < (keys.size() + 63) / 64) {
+    throw std::invalid_argument("containsInterleaved: output bitmask too small");
+  }
+  std::fill(out.begin(), out.begin() + (keys.size() + 63) / 64, 0);
+
+  std::size_t hits = 0;
+  probeInterleaved(keys, groupSize, [&](std::size_t i, std::optional<Link> it) {
+    if (it) {
+      out[i / 64] |= std::uint64_t {1} << (i % 64);
+      hits++;
+    }
+  });
+  return hits;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::findInterleaved(
+    std::span<const Key> keys, std::span<Iterator> out, std::size_t groupSize) {
+  if (out.size() < keys.size()) {
+    throw std::invalid_argument("findInterleaved: output span too small");
+  }
+  probeInterleaved(keys, groupSize, [&](std::size_t i, std::optional<Link> it) {
+    out[i] = iteratorOf(it.value_or(elements.end()));
+  });
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::growSize(std::size_t newSize) const {
+  // Appropriate new size is found from predefined sizes list.
+  // This needs to be at least as large as requested and satisfies the load factor constraint.
+
+  std::size_t new_size_ = sizes[0];
+  for (std::size_t size : sizes) {
+    if (size >= newSize && (static_cast<float>(size_) / size <= maxLoadFactor() || size == sizes.back())) {
+      new_size_ = size;
+      break;
+    }
+  }
+  return new_size_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::rehash(std::size_t newSize) {
+  while (rehashing()) {
+    migrateStep();
+  }
+
+  std::size_t new_size_ = growSize(newSize);
+
+// There is no need to reshash if the new size is not larger than the current size.
+  if (new_size_ <= bucketCount()) {
+    return;
+  }
+
+  rebuildBuckets(new_size_);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::rebuildBuckets(
+    std::size_t newSize) {
+  stats_.rehashStarted();
+  {
+    [[maybe_unused]] auto timing = stats_.timeRehash();
+    relink(newSize);
+  }
+  recountChains();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::shrinkSize() const {
+  for (std::size_t size : sizes) {
+    if (size >= bucketCount() || static_cast<float>(size_) / size <= maxLoadFactor() / 2) {
+      return std::min(size, bucketCount());
+    }
+  }
+  return bucketCount();
+}
+
+// relink() only walks the nodes and the new array, so shrinking a table that
+// has drained costs little more than freeing the old array.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::shrink_to_fit() {
+  while (rehashing()) {
+    migrateStep();
+  }
+
+  std::size_t new_size_ = shrinkSize();
+  if (new_size_ < bucketCount()) {
+    rebuildBuckets(new_size_);
+  }
+}
+
+// A table of n / maxLoadFactor() buckets holds n elements without growing.
+// Allocators that can hand out many nodes at once, such as PoolAllocator, are
+// also asked for the nodes still missing.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::reserve(std::size_t n) {
+  rehash(static_cast<std::size_t>(std::ceil(n / maxLoadFactor())));
+
+  NodeAllocator alloc(elements.get_allocator());
+  if constexpr (requires { alloc.reserve(n); }) {
+    if (n > size_) {
+      alloc.reserve(n - size_);
+    }
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::relink(std::size_t new_size_) {
+// A new buckets array is created with all elements.end().
+  std::vector<Link, BucketAllocator> newBuckets(new_size_, elements.end(),
+                                                    buckets.get_allocator());
+
+  BucketPolicy newPolicy(new_size_);
+
+  // Each element is processed in place using the list splice operation - this approach
+  // maintains iterator validity by rearranging the existing list instead of creating a new one.
+  for (auto it = elements.begin(); it != elements.end(); ) {
+    auto positionNow = it++; // Current position is saved and the iterator is advanced.
+    std::size_t newHashValue = newPolicy.index(hash_(keyOf(*positionNow)));
+    setBucketOf(positionNow, newHashValue);
+
+    if (newBuckets[newHashValue] == elements.end()) {
+      // First element for this bucket, just set the bucket pointer.
+      newBuckets[newHashValue] = positionNow;
+    }
+    else {
+      // The current head of the bucket chain is received.
+      auto oldPointer = newBuckets[newHashValue];
+
+// This element is spliced to come after the current chain - thus moving the element in the list
+// without invalidating its iterator.
+      elements.splice(oldPointer, elements, positionNow);
+
+// The bucket pointer is updated to point to this element now.
+      newBuckets[newHashValue] = positionNow;
+    }
+  }
+
+// The old buckets array is replaced with the new one.
+  std::swap(buckets, newBuckets);
+  policy_ = newPolicy;
+
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::grow(std::size_t newSize) {
+  if (!incremental_) {
+    rehash(newSize);
+    return;
+  }
+
+  while (rehashing()) {
+    migrateStep();
+  }
+  std::size_t new_size_ = growSize(newSize);
+  if (new_size_ <= bucketCount() || elements.empty()) {
+    rehash(newSize);
+    return;
+  }
+
+// Every node starts out unmigrated, behind an empty front region.
+  stats_.rehashStarted();
+  [[maybe_unused]] auto timing = stats_.timeRehash();
+  oldBuckets = std::move(buckets);
+  oldPolicy_ = policy_;
+  buckets = std::vector<Link, BucketAllocator>(new_size_, elements.end(),
+                                                   oldBuckets.get_allocator());
+  policy_ = BucketPolicy(new_size_);
+  migrated_ = 0;
+  boundary_ = elements.begin();
+}
+
+// An old chain is contiguous and lies behind boundary_, so its nodes are taken
+// from the front of it.  Each one is spliced in front of the head of its new
+// chain, or at the very front of the list when that chain is empty; both keep
+// the new chains contiguous without walking them.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::migrateStep() {
+  [[maybe_unused]] auto timing = stats_.timeRehash();
+  std::size_t moved = 0;
+  std::size_t visited = 0;
+
+  while (migrated_ < oldBuckets.size() && moved < kMigrateNodes && visited < kMigrateBuckets) {
+    Link it = oldBuckets[migrated_];
+    while (it != elements.end() && oldBucketOf(it) == migrated_) {
+      Link node = it++;
+      if (node == boundary_) {
+        boundary_ = it;
+      }
+      std::size_t idx = bucket(keyOf(*node));
+      setBucketOf(node, idx);
+      Link position = (buckets[idx] == elements.end()) ? elements.begin() : buckets[idx];
+      elements.splice(position, elements, node);
+      buckets[idx] = node;
+      moved++;
+    }
+    migrated_++;
+    visited++;
+  }
+
+  if (migrated_ == oldBuckets.size()) {
+    std::vector<Link, BucketAllocator>(oldBuckets.get_allocator()).swap(oldBuckets);
+    boundary_ = elements.end();
+    recountChains();
+  }
+}
+
+// Chains are contiguous, so each run of nodes sharing a bucket is one chain.
+// Costs a hash per node, which is why it only runs when the bucket array has
+// been rebuilt anyway.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::recountChains() {
+  if constexpr (hashset_detail::kStatsEnabled) {
+    stats_.lengthsCleared();
+    std::size_t chains = 0;
+    for (auto it = elements.begin(); it != elements.end(); ) {
+      std::size_t idx = bucketOf(it);
+      std::size_t length = 0;
+      while (it != elements.end() && bucketOf(it) == idx) {
+        length++;
+        ++it;
+      }
+      stats_.lengthAdded(length);
+      chains++;
+    }
+    stats_.lengthAdded(0, bucketCount() - chains);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::findMigrating(const Key& key) const
+    -> std::optional<Link> {
+  std::size_t h = hash_(key);
+  std::size_t old = oldPolicy_.index(h);
+
+  std::size_t probes = 0;
+  if (old >= migrated_) {
+    for (Link it = oldBuckets[old]; it != elements.end() && oldBucketOf(it) == old; ++it) {
+      probes++;
+      if (equal_(keyOf(*it), key)) {
+        stats_.lookup(true, probes);
+        return it;
+      }
+    }
+    stats_.lookup(false, probes);
+    return std::nullopt;
+  }
+
+  std::size_t idx = policy_.index(h);
+  for (Link it = buckets[idx]; it != boundary_ && bucketOf(it) == idx; ++it) {
+    probes++;
+    if (equal_(keyOf(*it), key)) {
+      stats_.lookup(true, probes);
+      return it;
+    }
+  }
+  stats_.lookup(false, probes);
+  return std::nullopt;
+}
+
+// New nodes go in front of the head of their chain, or at the front of their
+// region when the chain is empty: the very front for migrated buckets, the
+// very back for the others.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <typename K>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insertMigrating(K&& key)
+    -> Link {
+  std::size_t h = hash_(key);
+  std::size_t old = oldPolicy_.index(h);
+  Link node;
+
+  if (old >= migrated_) {
+    Link head = oldBuckets[old];
+    node = insertNode(head, std::forward<K>(key), old);
+    oldBuckets[old] = node;
+    if (boundary_ == head) {
+      boundary_ = node;
+    }
+  }
+  else {
+    std::size_t idx = policy_.index(h);
+    Link position = (buckets[idx] == elements.end()) ? elements.begin() : buckets[idx];
+    node = insertNode(position, std::forward<K>(key), idx);
+    buckets[idx] = node;
+  }
+
+  size_++;
+  return node;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::incrementalRehash(bool on) {
+  incremental_ = on;
+  while (!on && rehashing()) {
+    migrateStep();
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+bool ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::incrementalRehash() const {
+  return incremental_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+bool ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::rehashing() const {
+  return !oldBuckets.empty();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::clear() {
+  elements.clear();
+  std::vector<Link, BucketAllocator>(oldBuckets.get_allocator()).swap(oldBuckets);
+  boundary_ = elements.end();
+  std::fill(buckets.begin(), buckets.end(), elements.end());
+  size_ = 0;
+  stats_.lengthsCleared();
+  stats_.lengthAdded(0, bucketCount());
+}
+
+// While an incremental rehash is running every node already has its bucket in
+// the new array, which is the one saved.
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::save(const std::string& path) const {
+  hashset_detail::writeSnapshot<Key>(
+      path, bucketCount(), size_,
+      [this](auto f) {
+        for (const Node& node : elements) {
+          f(keyOf(node));
+        }
+      },
+      [this](const Key& key) { return bucket(key); });
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::openMapped(const std::string& path,
+                                                                             bool verify) -> Mapped {
+  return Mapped(path, verify);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::size() const {
+  return size_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+bool ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::empty() const {
+  return (size_ == 0);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::bucketCount() const {
+  return buckets.size();
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::bucketSize(std::size_t b) const {
+
+// If the bucket index is invalid or the bucket is empty, then 0 is returned.
+  if (b >= bucketCount() || buckets[b] == elements.end()) {
+    return 0;
+  }
+
+// The elements in this bucket are counted by traversing the list. Elements with the
+// same hash value are stored contiguously.
+  std::size_t c = 0;
+  auto it = buckets[b];
+  auto chainEnd = rehashing() ? boundary_ : elements.end();
+
+  while (it != chainEnd && bucketOf(it) == b) {
+    c++; // Magical moment here (if you know, you know).
+    ++it;
+  }
+
+  return c;
+
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::bucket(const Key& key) const {
+  return policy_.index(hash_(key));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+const Key& ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::keyOf(const Node& node) {
+  if constexpr (kCachedBucket) {
+    return node.key;
+  }
+  else {
+    return node;
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::bucketOf(Link node) const {
+  if constexpr (kCachedBucket) {
+    if (buckets.size() > hashset_detail::kMaxCachedBuckets) {
+      return bucket(node->key);
+    }
+    return node->bucket;
+  }
+  else {
+    return bucket(*node);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+std::size_t ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::oldBucketOf(Link node) const {
+  if constexpr (kCachedBucket) {
+    if (oldBuckets.size() > hashset_detail::kMaxCachedBuckets) {
+      return oldPolicy_.index(hash_(node->key));
+    }
+    return node->bucket;
+  }
+  else {
+    return oldPolicy_.index(hash_(*node));
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::setBucketOf(
+    [[maybe_unused]] Link node, [[maybe_unused]] std::size_t b) {
+  if constexpr (kCachedBucket) {
+    node->bucket = static_cast<std::uint32_t>(b);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+template <typename K>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::insertNode(
+    Link position, K&& key, [[maybe_unused]] std::size_t b) -> Link {
+  if constexpr (kCachedBucket) {
+    return elements.insert(position, Node {std::forward<K>(key), static_cast<std::uint32_t>(b)});
+  }
+  else {
+    return elements.insert(position, std::forward<K>(key));
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::iteratorOf(Link node)
+    -> Iterator {
+  return Iterator(node);
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+auto ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::linkOf(Iterator it)
+    -> Link {
+  if constexpr (kCachedBucket) {
+    return it.base();
+  }
+  else {
+    return it;
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+float ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::loadFactor() const {
+  if (bucketCount() == 0) {
+    return 0.0f;
+  }
+  return (static_cast<float>(size()) / bucketCount());
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+float ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::maxLoadFactor() const {
+  return max_load_factor_;
+}
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::maxLoadFactor(float maxLoad) {
+  max_load_factor_ = maxLoad;
+
+// If the current load factor exceeds the new maximum, then reshash immediately.
+  if (loadFactor() > max_load_factor_) {
+    std::size_t reqBuckets = std::ceil(size_ / max_load_factor_);
+    rehash(reqBuckets);
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+float ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::minLoadFactor() const {
+  return min_load_factor_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::minLoadFactor(float minLoad) {
+  min_load_factor_ = minLoad;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+Allocator ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::get_allocator() const {
+  return Allocator(elements.get_allocator());
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+Hash ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::hash_function() const {
+  return hash_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+KeyEqual ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::key_eq() const {
+  return equal_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+HashSetStats ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::stats() const {
+  return stats_.snapshot();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename Allocator,
+          typename BucketPolicy, typename NodeLayout>
+void ChainedHashSet<Key, Hash, KeyEqual, Allocator, BucketPolicy, NodeLayout>::resetStats() {
+  stats_.reset();
+}
+
+// The backend behind HashSet is picked at compile time.  Define
+// HASHSET_FLAT_BACKEND to use the open-addressing FlatHashSet instead
+// of the node-based ChainedHashSet.
+#ifdef HASHSET_FLAT_BACKEND
+using HashSet = FlatHashSet<int>;
+#else
+using HashSet = ChainedHashSet<int>;
+#endif
+
 #endif      // HASH_HPP_
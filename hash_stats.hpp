@@ -0,0 +1,226 @@
+#ifndef HASH_STATS_HPP_
+#define HASH_STATS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Table health counters for ChainedHashSet and FlatHashSet.  They are only
+// kept when HASHSET_STATS is defined; otherwise every update compiles to
+// nothing, the counters take no space, and stats() returns zeros with
+// enabled false.
+
+// chain lengths from this one on share the last entry of the histogram
+inline constexpr std::size_t kChainHistogram = 16;
+
+// A snapshot taken by stats().  Lookups are those made by contains, find,
+// containsBatch, insert (which first looks the key up) and erase of a key.
+struct HashSetStats {
+  bool enabled = false;
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  // what the lookups inspected: chain nodes for ChainedHashSet, control
+  // groups for FlatHashSet
+  std::uint64_t probes = 0;
+  std::uint64_t maxProbe = 0;
+  // rehashes started, and all the time spent on them, including the
+  // migration steps of incremental rehashes
+  std::uint64_t rehashes = 0;
+  std::chrono::nanoseconds rehashTime {0};
+  // ChainedHashSet: chainLengths[k] buckets hold k keys.  While an
+  // incremental rehash runs it still describes the table from before.
+  // FlatHashSet: chainLengths[k] keys sit k groups past their home group.
+  // The last entry also counts everything longer.
+  std::array<std::uint64_t, kChainHistogram> chainLengths {};
+
+  std::uint64_t lookups() const {
+    return hits + misses;
+  }
+
+  double meanProbe() const {
+    return lookups() == 0 ? 0 : static_cast<double>(probes) / lookups();
+  }
+};
+
+namespace hashset_detail {
+
+#ifdef HASHSET_STATS
+
+inline constexpr bool kStatsEnabled = true;
+
+// Lookups run under const and, in the concurrent wrappers, on several
+// threads at once, so their counters are relaxed atomics.  They are split
+// over a few cache lines, one picked per thread, so that readers do not
+// bounce a shared line between cores; snapshot() adds them up.  Everything
+// else only changes with the set itself.
+class StatsCounters {
+ private:
+  static constexpr std::size_t kCacheLine = 64;
+  static constexpr std::size_t kLookupShards = 8;
+
+  struct alignas(kCacheLine) LookupShard {
+    std::atomic<std::uint64_t> hits {0};
+    std::atomic<std::uint64_t> misses {0};
+    std::atomic<std::uint64_t> probes {0};
+    std::atomic<std::uint64_t> maxProbe {0};
+  };
+
+  mutable std::array<LookupShard, kLookupShards> lookups_;
+  std::uint64_t rehashes_ = 0;
+  std::chrono::nanoseconds rehashTime_ {0};
+  std::array<std::uint64_t, kChainHistogram> lengths_ {};
+
+  static std::size_t slot(std::size_t length) {
+    return std::min(length, kChainHistogram - 1);
+  }
+
+  static std::size_t lookupShard() {
+    static std::atomic<std::size_t> nextShard {0};
+    thread_local std::size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kLookupShards;
+    return shard;
+  }
+
+  // copies the totals of other into the first shard and zeroes the rest
+  void copyLookups(const StatsCounters& other) {
+    HashSetStats totals = other.snapshot();
+    resetLookups();
+    lookups_[0].hits.store(totals.hits, std::memory_order_relaxed);
+    lookups_[0].misses.store(totals.misses, std::memory_order_relaxed);
+    lookups_[0].probes.store(totals.probes, std::memory_order_relaxed);
+    lookups_[0].maxProbe.store(totals.maxProbe, std::memory_order_relaxed);
+  }
+
+  void resetLookups() {
+    for (LookupShard& shard : lookups_) {
+      shard.hits.store(0, std::memory_order_relaxed);
+      shard.misses.store(0, std::memory_order_relaxed);
+      shard.probes.store(0, std::memory_order_relaxed);
+      shard.maxProbe.store(0, std::memory_order_relaxed);
+    }
+  }
+
+ public:
+  class RehashTimer {
+   private:
+    StatsCounters& stats_;
+    std::chrono::steady_clock::time_point start_;
+
+   public:
+    explicit RehashTimer(StatsCounters& stats)
+        : stats_(stats), start_(std::chrono::steady_clock::now()) {}
+
+    RehashTimer(const RehashTimer&) = delete;
+    RehashTimer& operator=(const RehashTimer&) = delete;
+
+    ~RehashTimer() {
+      stats_.rehashTime_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_);
+    }
+  };
+
+  StatsCounters() = default;
+
+  StatsCounters(const StatsCounters& other)
+      : rehashes_(other.rehashes_), rehashTime_(other.rehashTime_), lengths_(other.lengths_) {
+    copyLookups(other);
+  }
+
+  StatsCounters& operator=(const StatsCounters& other) {
+    copyLookups(other);
+    rehashes_ = other.rehashes_;
+    rehashTime_ = other.rehashTime_;
+    lengths_ = other.lengths_;
+    return *this;
+  }
+
+  void lookup(bool hit, std::size_t probes) const {
+    LookupShard& shard = lookups_[lookupShard()];
+    (hit ? shard.hits : shard.misses).fetch_add(1, std::memory_order_relaxed);
+    shard.probes.fetch_add(probes, std::memory_order_relaxed);
+    std::uint64_t seen = shard.maxProbe.load(std::memory_order_relaxed);
+    while (probes > seen &&
+           !shard.maxProbe.compare_exchange_weak(seen, probes, std::memory_order_relaxed)) {
+    }
+  }
+
+  // counts a new rehash; the time is added by timeRehash()
+  void rehashStarted() {
+    rehashes_++;
+  }
+
+  RehashTimer timeRehash() {
+    return RehashTimer(*this);
+  }
+
+  void lengthAdded(std::size_t length, std::uint64_t n = 1) {
+    lengths_[slot(length)] += n;
+  }
+
+  void lengthRemoved(std::size_t length) {
+    lengths_[slot(length)]--;
+  }
+
+  void lengthMoved(std::size_t from, std::size_t to) {
+    lengthRemoved(from);
+    lengthAdded(to);
+  }
+
+  void lengthsCleared() {
+    lengths_.fill(0);
+  }
+
+  // zeroes the lookup and rehash counters; the lengths describe the table
+  // and are kept
+  void reset() {
+    resetLookups();
+    rehashes_ = 0;
+    rehashTime_ = std::chrono::nanoseconds {0};
+  }
+
+  HashSetStats snapshot() const {
+    HashSetStats s;
+    s.enabled = true;
+    for (const LookupShard& shard : lookups_) {
+      s.hits += shard.hits.load(std::memory_order_relaxed);
+      s.misses += shard.misses.load(std::memory_order_relaxed);
+      s.probes += shard.probes.load(std::memory_order_relaxed);
+      s.maxProbe = std::max(s.maxProbe, shard.maxProbe.load(std::memory_order_relaxed));
+    }
+    s.rehashes = rehashes_;
+    s.rehashTime = rehashTime_;
+    s.chainLengths = lengths_;
+    return s;
+  }
+};
+
+#else
+
+inline constexpr bool kStatsEnabled = false;
+
+// Same interface as above, doing nothing.
+class StatsCounters {
+ public:
+  struct RehashTimer {};
+
+  void lookup(bool, std::size_t) const {}
+  void rehashStarted() {}
+  RehashTimer timeRehash() { return {}; }
+  void lengthAdded(std::size_t, std::uint64_t = 1) {}
+  void lengthRemoved(std::size_t) {}
+  void lengthMoved(std::size_t, std::size_t) {}
+  void lengthsCleared() {}
+  void reset() {}
+
+  HashSetStats snapshot() const {
+    return {};
+  }
+};
+
+#endif
+
+}  // namespace hashset_detail
+
+#endif      // HASH_STATS_HPP_
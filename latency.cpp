@@ -0,0 +1,484 @@
+// latency: times every single operation of a set as it grows to n keys and
+// reports the tail, so that the inserts which rehash the whole table show up
+// instead of disappearing into an average.
+//
+//   g++ -std=c++20 -O2 -march=native latency.cpp -o latency
+//
+//   latency [options]
+//     -n, --keys N            keys inserted, looked up and erased (default 1M)
+//     -d, --distribution D    uniform, sequential, negative, zipf or
+//                             prime_stride (default uniform)
+//     -s, --strategy S        run only strategy S; may be repeated
+//     -c, --clock tsc|steady  time source (default tsc on x86)
+//     -o, --csv FILE          write the percentiles as CSV
+//     -p, --spikes FILE       write every operation that rehashed as CSV
+//
+// Each strategy (a set type and how it is set up, see kStrategies) inserts
+// the keys one by one into an empty set, looks every key up, looks up as
+// many absent keys and erases the keys again.  Every operation is timed on
+// its own and counted in a histogram by operation and tag:
+//
+//   rehash      the bucket count changed during the operation
+//   migrating   an incremental rehash was in progress
+//   plain       anything else
+//
+// Histograms are log-linear in the manner of HdrHistogram: exact below 128
+// ticks, then 128 buckets per power of two, so every value is kept to within
+// 1%.  The tsc clock reads the time-stamp counter between fences; it is
+// calibrated against steady_clock at startup and assumes an invariant TSC.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "bench_keys.hpp"
+#include "flat_hash.hpp"
+#include "hash.hpp"
+
+namespace {
+
+using bench_keys::Distribution;
+
+//*** Clock
+
+class Clock {
+ private:
+  bool tsc_;
+  double nsPerTick_;
+
+#if defined(__x86_64__) || defined(__i386__)
+  static std::uint64_t readTsc() {
+    _mm_lfence();
+    std::uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+  }
+#else
+  static std::uint64_t readTsc() {
+    throw std::runtime_error("no time-stamp counter on this machine");
+  }
+#endif
+
+  static std::uint64_t readSteady() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ public:
+  explicit Clock(bool tsc) : tsc_(tsc), nsPerTick_(1) {
+    if (!tsc_) {
+      return;
+    }
+    // 50ms against steady_clock is good to well under 0.1%
+    std::uint64_t s0 = readSteady();
+    std::uint64_t t0 = readTsc();
+    while (readSteady() - s0 < 50'000'000) {
+    }
+    std::uint64_t s1 = readSteady();
+    std::uint64_t t1 = readTsc();
+    nsPerTick_ = static_cast<double>(s1 - s0) / static_cast<double>(t1 - t0);
+  }
+
+  std::uint64_t now() const {
+    return tsc_ ? readTsc() : readSteady();
+  }
+
+  double toNs(std::uint64_t ticks) const {
+    return ticks * nsPerTick_;
+  }
+
+  const char* name() const {
+    return tsc_ ? "tsc" : "steady";
+  }
+};
+
+//*** Histogram
+
+class Histogram {
+ private:
+  static constexpr unsigned kSubBits = 7;
+  static constexpr std::uint64_t kSub = std::uint64_t {1} << kSubBits;
+
+  std::vector<std::uint64_t> counts;
+  std::uint64_t count_ = 0;
+  std::uint64_t max_ = 0;
+  double sum_ = 0;
+
+  static std::size_t indexOf(std::uint64_t v) {
+    if (v < kSub) {
+      return v;
+    }
+    unsigned shift = (63 - std::countl_zero(v)) - kSubBits;
+    return ((shift + 1) << kSubBits) + ((v >> shift) - kSub);
+  }
+
+  // the largest value counted in bucket i
+  static std::uint64_t highest(std::size_t i) {
+    if (i < kSub) {
+      return i;
+    }
+    unsigned shift = i / kSub - 1;
+    std::uint64_t low = (kSub + i % kSub) << shift;
+    return low + ((std::uint64_t {1} << shift) - 1);
+  }
+
+ public:
+  Histogram() : counts((64 - kSubBits + 1) * kSub, 0) {}
+
+  void record(std::uint64_t v) {
+    ++counts[indexOf(v)];
+    ++count_;
+    max_ = std::max(max_, v);
+    sum_ += static_cast<double>(v);
+  }
+
+  std::uint64_t count() const {
+    return count_;
+  }
+
+  std::uint64_t max() const {
+    return max_;
+  }
+
+  double mean() const {
+    return count_ == 0 ? 0 : sum_ / count_;
+  }
+
+  // the smallest value that at least q of all values do not exceed, to the
+  // resolution of the buckets
+  std::uint64_t quantile(double q) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(q * count_ + 0.5);
+    rank = std::clamp<std::uint64_t>(rank, 1, count_);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return std::min(highest(i), max_);
+      }
+    }
+    return max_;
+  }
+};
+
+//*** Recording
+
+enum Tag { kPlain, kRehash, kMigrating, kTags };
+
+const char* const kTagNames[kTags] = {"plain", "rehash", "migrating"};
+
+enum Operation { kInsert, kContainsHit, kContainsMiss, kErase, kOperations };
+
+const char* const kOperationNames[kOperations] = {"insert", "contains_hit", "contains_miss",
+                                                  "erase"};
+
+// one operation that rehashed
+struct Spike {
+  Operation operation;
+  std::size_t index;      // position in its phase
+  std::size_t size;       // keys in the set before
+  std::size_t bucketsBefore;
+  std::size_t bucketsAfter;
+  std::uint64_t ticks;
+};
+
+struct Result {
+  std::string strategy;
+  std::array<std::array<Histogram, kTags>, kOperations> histograms;
+  std::vector<Spike> spikes;
+};
+
+template <typename Set>
+std::size_t bucketsOf(const Set& h) {
+  if constexpr (requires { h.bucketCount(); }) {
+    return h.bucketCount();
+  }
+  else {
+    return h.bucket_count();
+  }
+}
+
+template <typename Set>
+bool migrating(const Set& h) {
+  if constexpr (requires { h.rehashing(); }) {
+    return h.rehashing();
+  }
+  else {
+    return false;
+  }
+}
+
+// Times op(key) for every key and files it under op's histograms.
+template <typename Set, typename Op>
+void timePhase(Set& h, Operation operation, const std::vector<int>& keys, const Clock& clock,
+               Result& result, Op op) {
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    std::size_t size = h.size();
+    std::size_t before = bucketsOf(h);
+    bool wasMigrating = migrating(h);
+    std::uint64_t start = clock.now();
+    op(keys[i]);
+    std::uint64_t ticks = clock.now() - start;
+    std::size_t after = bucketsOf(h);
+
+    Tag tag = (after != before) ? kRehash : (wasMigrating || migrating(h)) ? kMigrating : kPlain;
+    result.histograms[operation][tag].record(ticks);
+    if (tag == kRehash) {
+      result.spikes.push_back({operation, i, size, before, after, ticks});
+    }
+  }
+}
+
+template <typename Set>
+Result run(const char* strategy, Set h, const bench_keys::Keys& keys, const Clock& clock) {
+  Result result;
+  result.strategy = strategy;
+  std::size_t found = 0;
+  timePhase(h, kInsert, keys.present, clock, result, [&h](int k) { h.insert(k); });
+  timePhase(h, kContainsHit, keys.hits, clock, result, [&](int k) { found += h.contains(k); });
+  timePhase(h, kContainsMiss, keys.absent, clock, result, [&](int k) { found += h.contains(k); });
+  timePhase(h, kErase, keys.present, clock, result, [&h](int k) { h.erase(k); });
+  if (found != keys.hits.size()) {
+    throw std::logic_error(std::string(strategy) + ": lookups went wrong");
+  }
+  return result;
+}
+
+//*** Strategies
+
+// How a set grows.  A new rehash strategy gets a line here and shows up in
+// every report next to the existing ones.
+struct Strategy {
+  const char* name;
+  std::function<Result(const bench_keys::Keys&, const Clock&)> run;
+};
+
+const Strategy kStrategies[] = {
+    {"chained", [](const bench_keys::Keys& keys, const Clock& clock) {
+       return run("chained", ChainedHashSet<int>(), keys, clock);
+     }},
+    {"chained_incremental", [](const bench_keys::Keys& keys, const Clock& clock) {
+       ChainedHashSet<int> h;
+       h.incrementalRehash(true);
+       return run("chained_incremental", std::move(h), keys, clock);
+     }},
+    {"chained_reserved", [](const bench_keys::Keys& keys, const Clock& clock) {
+       ChainedHashSet<int> h;
+       h.reserve(keys.present.size());
+       return run("chained_reserved", std::move(h), keys, clock);
+     }},
+    {"flat", [](const bench_keys::Keys& keys, const Clock& clock) {
+       return run("flat", FlatHashSet<int>(), keys, clock);
+     }},
+    {"std", [](const bench_keys::Keys& keys, const Clock& clock) {
+       return run("std", std::unordered_set<int>(), keys, clock);
+     }},
+};
+
+//*** Command line
+
+struct Options {
+  std::size_t keys = 1'000'000;
+  Distribution distribution = Distribution::kUniform;
+  std::vector<std::string> strategies;
+#if defined(__x86_64__) || defined(__i386__)
+  bool tsc = true;
+#else
+  bool tsc = false;
+#endif
+  std::string csv;
+  std::string spikes;
+};
+
+[[noreturn]] void usage(const char* message) {
+  std::fprintf(stderr, "latency: %s\n"
+               "usage: latency [-n keys] [-d distribution] [-s strategy]... [-c tsc|steady]"
+               " [-o csv] [-p spikes]\n", message);
+  std::exit(2);
+}
+
+std::size_t parseCount(const char* text) {
+  char* end = nullptr;
+  unsigned long long n = std::strtoull(text, &end, 10);
+  if (end == text || *end != '\0' || n == 0) {
+    usage("expected a positive number");
+  }
+  return static_cast<std::size_t>(n);
+}
+
+Options parseOptions(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto value = [&]() {
+      if (i + 1 == argc) {
+        usage("missing option value");
+      }
+      return argv[++i];
+    };
+    if (arg == "-n" || arg == "--keys") {
+      options.keys = parseCount(value());
+    }
+    else if (arg == "-d" || arg == "--distribution") {
+      std::string_view d = value();
+      auto it = std::find_if(std::begin(bench_keys::kDistributions),
+                             std::end(bench_keys::kDistributions),
+                             [d](Distribution x) { return d == bench_keys::name(x); });
+      if (it == std::end(bench_keys::kDistributions)) {
+        usage("unknown distribution");
+      }
+      options.distribution = *it;
+    }
+    else if (arg == "-s" || arg == "--strategy") {
+      std::string_view s = value();
+      if (std::none_of(std::begin(kStrategies), std::end(kStrategies),
+                       [s](const Strategy& x) { return s == x.name; })) {
+        usage("unknown strategy");
+      }
+      options.strategies.emplace_back(s);
+    }
+    else if (arg == "-c" || arg == "--clock") {
+      std::string_view c = value();
+      if (c != "tsc" && c != "steady") {
+        usage("unknown clock");
+      }
+      options.tsc = (c == "tsc");
+    }
+    else if (arg == "-o" || arg == "--csv") {
+      options.csv = value();
+    }
+    else if (arg == "-p" || arg == "--spikes") {
+      options.spikes = value();
+    }
+    else {
+      usage("unknown option");
+    }
+  }
+  return options;
+}
+
+//*** Reports
+
+struct File {
+  std::FILE* f;
+
+  explicit File(const std::string& path) : f(std::fopen(path.c_str(), "w")) {
+    if (f == nullptr) {
+      hashset_detail::throwErrno("cannot create " + path);
+    }
+  }
+
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+
+  ~File() {
+    std::fclose(f);
+  }
+};
+
+void printTable(const std::vector<Result>& results, const Clock& clock) {
+  std::printf("%-20s %-14s %-10s %10s %9s %9s %9s %9s %11s\n", "strategy", "operation", "tag",
+              "count", "mean", "p50", "p99", "p99.9", "max (ns)");
+  for (const Result& r : results) {
+    for (int op = 0; op < kOperations; ++op) {
+      for (int tag = 0; tag < kTags; ++tag) {
+        const Histogram& h = r.histograms[op][tag];
+        if (h.count() == 0) {
+          continue;
+        }
+        std::printf("%-20s %-14s %-10s %10llu %9.0f %9.0f %9.0f %9.0f %11.0f\n",
+                    r.strategy.c_str(), kOperationNames[op], kTagNames[tag],
+                    static_cast<unsigned long long>(h.count()), h.mean() * clock.toNs(1),
+                    clock.toNs(h.quantile(0.5)), clock.toNs(h.quantile(0.99)),
+                    clock.toNs(h.quantile(0.999)), clock.toNs(h.max()));
+      }
+    }
+  }
+}
+
+void writeCsv(const std::string& path, const std::vector<Result>& results, const Options& options,
+              const Clock& clock) {
+  File out(path);
+  std::fprintf(out.f, "strategy,distribution,keys,clock,operation,tag,count,mean_ns,p50_ns,"
+               "p99_ns,p999_ns,max_ns\n");
+  for (const Result& r : results) {
+    for (int op = 0; op < kOperations; ++op) {
+      for (int tag = 0; tag < kTags; ++tag) {
+        const Histogram& h = r.histograms[op][tag];
+        if (h.count() == 0) {
+          continue;
+        }
+        std::fprintf(out.f, "%s,%s,%zu,%s,%s,%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                     r.strategy.c_str(), bench_keys::name(options.distribution), options.keys,
+                     clock.name(), kOperationNames[op], kTagNames[tag],
+                     static_cast<unsigned long long>(h.count()), h.mean() * clock.toNs(1),
+                     clock.toNs(h.quantile(0.5)), clock.toNs(h.quantile(0.99)),
+                     clock.toNs(h.quantile(0.999)), clock.toNs(h.max()));
+      }
+    }
+  }
+}
+
+void writeSpikes(const std::string& path, const std::vector<Result>& results, const Clock& clock) {
+  File out(path);
+  std::fprintf(out.f, "strategy,operation,index,size,buckets_before,buckets_after,ns\n");
+  for (const Result& r : results) {
+    for (const Spike& s : r.spikes) {
+      std::fprintf(out.f, "%s,%s,%zu,%zu,%zu,%zu,%.1f\n", r.strategy.c_str(),
+                   kOperationNames[s.operation], s.index, s.size, s.bucketsBefore, s.bucketsAfter,
+                   clock.toNs(s.ticks));
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options = parseOptions(argc, argv);
+
+  try {
+    Clock clock(options.tsc);
+    bench_keys::Keys keys = bench_keys::makeKeys(options.distribution, options.keys, 2'017);
+
+    std::vector<Result> results;
+    for (const Strategy& s : kStrategies) {
+      if (options.strategies.empty() ||
+          std::find(options.strategies.begin(), options.strategies.end(), s.name) !=
+              options.strategies.end()) {
+        results.push_back(s.run(keys, clock));
+      }
+    }
+
+    std::printf("%zu %s keys, clock %s\n", options.keys, bench_keys::name(options.distribution),
+                clock.name());
+    printTable(results, clock);
+    if (!options.csv.empty()) {
+      writeCsv(options.csv, results, options, clock);
+    }
+    if (!options.spikes.empty()) {
+      writeSpikes(options.spikes, results, clock);
+    }
+  }
+  catch (const std::exception& e) {
+    std::fprintf(stderr, "latency: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,226 @@
+#ifndef LEFTRIGHT_HASH_HPP_
+#define LEFTRIGHT_HASH_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include "hash.hpp"
+
+// Read-mostly set after Ramalhete and Correia's Left-Right technique.  Two
+// copies of the set are kept.  Readers always use the copy that leftRight_
+// points at and never wait: arriving and departing is one atomic increment
+// each.  The writer changes the other copy, flips leftRight_ with one store,
+// waits until no reader can still be on the old copy and then applies the
+// same change to it.  Writers are serialised by a mutex and may wait.
+//
+// Readers announce themselves in one of several read indicators, each on its
+// own cache line and picked per thread, so reads do not bounce a shared
+// counter between cores.  Two sets of indicators alternate (versionIndex_),
+// so that a steady stream of new readers cannot keep the writer waiting.
+template <typename Set = HashSet>
+class LeftRightHashSet {
+ private:
+  static constexpr std::size_t kCacheLine = 64;
+  static constexpr std::size_t kReadSlots = 32;
+
+  struct alignas(kCacheLine) ReadSlot {
+    std::atomic<std::size_t> readers {0};
+  };
+
+  using Indicator = std::array<ReadSlot, kReadSlots>;
+
+  std::array<Set, 2> sets;
+  alignas(kCacheLine) std::atomic<std::size_t> leftRight_ {0};
+  std::atomic<std::size_t> versionIndex_ {0};
+  mutable std::array<Indicator, 2> indicators;
+  std::mutex writer_;
+
+  static std::size_t readSlot();
+
+  bool idle(const Indicator& indicator) const;
+
+  // publishes the written copy and waits until the other one has no readers
+  void flip();
+
+  // update() for a caller that already holds writer_
+  template <typename F>
+  void apply(F& f);
+
+ public:
+  using Key = typename Set::key_type;
+  using key_type = Key;
+  using value_type = Key;
+
+  LeftRightHashSet() = default;
+
+  explicit LeftRightHashSet(const Set& set);
+
+  LeftRightHashSet(const LeftRightHashSet&) = delete;
+  LeftRightHashSet& operator=(const LeftRightHashSet&) = delete;
+
+  //*** Readers, wait-free
+
+  bool contains(const Key& key) const;
+
+  // return a copy of the stored key equal to key, if any.  Iterators into
+  // the set would not outlive the read.
+  std::optional<Key> find(const Key& key) const;
+
+  std::size_t size() const;
+
+  // calls f(const Set&) on the current copy and returns its result.  f must
+  // not keep references into the set.
+  template <typename F>
+  auto read(F f) const;
+
+  //*** Writers, serialised
+
+  // return whether key was inserted
+  bool insert(const Key& key);
+
+  // return whether key was erased
+  bool erase(const Key& key);
+
+  void insertBatch(std::span<const Key> keys);
+
+  // applies f(Set&) to both copies in turn, so f must do the same thing
+  // every time it is called
+  template <typename F>
+  void update(F f);
+};
+
+
+template <typename Set>
+LeftRightHashSet<Set>::LeftRightHashSet(const Set& set) : sets {set, set} {
+}
+
+// Threads are spread over the slots by a counter, not by their id, so that a
+// small number of threads never share a slot.
+template <typename Set>
+std::size_t LeftRightHashSet<Set>::readSlot() {
+  static std::atomic<std::size_t> nextSlot {0};
+  thread_local std::size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % kReadSlots;
+  return slot;
+}
+
+template <typename Set>
+bool LeftRightHashSet<Set>::idle(const Indicator& indicator) const {
+  for (const ReadSlot& s : indicator) {
+    if (s.readers.load() != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Set>
+template <typename F>
+auto LeftRightHashSet<Set>::read(F f) const {
+  std::size_t slot = readSlot();
+  std::size_t vi = versionIndex_.load();
+  indicators[vi][slot].readers.fetch_add(1);
+
+  struct Depart {
+    std::atomic<std::size_t>& readers;
+    ~Depart() {
+      readers.fetch_sub(1);
+    }
+  } depart {indicators[vi][slot].readers};
+
+  return f(sets[leftRight_.load()]);
+}
+
+template <typename Set>
+bool LeftRightHashSet<Set>::contains(const Key& key) const {
+  return read([&key](const Set& set) { return set.contains(key); });
+}
+
+template <typename Set>
+auto LeftRightHashSet<Set>::find(const Key& key) const -> std::optional<Key> {
+  return read([&key](const Set& set) -> std::optional<Key> {
+    // Set::find is not const, but only reads
+    auto& s = const_cast<Set&>(set);
+    auto it = s.find(key);
+    if (it == s.end()) {
+      return std::nullopt;
+    }
+    return *it;
+  });
+}
+
+template <typename Set>
+std::size_t LeftRightHashSet<Set>::size() const {
+  return read([](const Set& set) { return set.size(); });
+}
+
+// After the flip new readers go to the written copy.  Readers that arrived
+// before it may be on either copy, and they are drained in two rounds: new
+// readers are pointed at the other indicator, the old one is waited on, and
+// then the same for the first.
+template <typename Set>
+void LeftRightHashSet<Set>::flip() {
+  leftRight_.store(1 - leftRight_.load());
+
+  std::size_t prev = versionIndex_.load();
+  std::size_t next = 1 - prev;
+  while (!idle(indicators[next])) {
+    std::this_thread::yield();
+  }
+  versionIndex_.store(next);
+  while (!idle(indicators[prev])) {
+    std::this_thread::yield();
+  }
+}
+
+template <typename Set>
+template <typename F>
+void LeftRightHashSet<Set>::apply(F& f) {
+  std::size_t lr = leftRight_.load();
+  f(sets[1 - lr]);
+  flip();
+  f(sets[lr]);
+}
+
+template <typename Set>
+template <typename F>
+void LeftRightHashSet<Set>::update(F f) {
+  std::lock_guard lock {writer_};
+  apply(f);
+}
+
+// Both copies hold the same keys while the writer lock is held, and readers
+// never modify them, so the writer can check its copy first and skip the flip
+// when a key is already there (or absent, for erase).
+template <typename Set>
+bool LeftRightHashSet<Set>::insert(const Key& key) {
+  std::lock_guard lock {writer_};
+  if (sets[leftRight_.load()].contains(key)) {
+    return false;
+  }
+  auto f = [&key](Set& set) { set.insert(key); };
+  apply(f);
+  return true;
+}
+
+template <typename Set>
+bool LeftRightHashSet<Set>::erase(const Key& key) {
+  std::lock_guard lock {writer_};
+  if (!sets[leftRight_.load()].contains(key)) {
+    return false;
+  }
+  auto f = [&key](Set& set) { set.erase(key); };
+  apply(f);
+  return true;
+}
+
+template <typename Set>
+void LeftRightHashSet<Set>::insertBatch(std::span<const Key> keys) {
+  update([keys](Set& set) { set.insertBatch(keys); });
+}
+
+#endif      // LEFTRIGHT_HASH_HPP_
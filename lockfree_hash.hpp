@@ -0,0 +1,539 @@
+#ifndef LOCKFREE_HASH_HPP_
+#define LOCKFREE_HASH_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "bucket_policy.hpp"
+
+namespace hashset_detail {
+
+//*** Epoch-based reclamation
+//
+// A node that has been unlinked can still be in use by a thread that read a
+// pointer to it just before.  Every operation therefore runs inside an epoch
+// guard, and unlinked nodes are retired instead of deleted.  The global epoch
+// only advances when every thread inside a guard has seen the current one, so
+// once it is two steps past the epoch a node was retired in, no thread can
+// still hold the node and it is freed.
+//
+// Each thread owns one record, reused by later threads once it exits, with
+// three limbo lists indexed by epoch modulo 3.  Nothing here takes a lock.
+
+struct Retired {
+  void* p;
+  void (*destroy)(void*);
+};
+
+struct EpochRecord {
+  std::atomic<std::uint64_t> epoch {0};
+  std::atomic<bool> active {false};
+  std::atomic<bool> inUse {true};
+  // set once when the record is published, never changed
+  EpochRecord* next = nullptr;
+
+  // the fields below are only touched by the owning thread
+  std::size_t depth = 0;
+  std::size_t retiredSinceScan = 0;
+  std::array<std::vector<Retired>, 3> limbo;
+  std::array<std::uint64_t, 3> limboEpoch {};
+
+  void free(std::size_t i) {
+    for (Retired& r : limbo[i]) {
+      r.destroy(r.p);
+    }
+    limbo[i].clear();
+  }
+};
+
+class EpochDomain {
+ private:
+  // retirements between two attempts to advance the epoch
+  static constexpr std::size_t kScanInterval = 64;
+
+  std::atomic<std::uint64_t> global_ {0};
+  std::atomic<EpochRecord*> head_ {nullptr};
+
+  // releases the calling thread's record when it exits
+  struct ThreadHandle {
+    EpochRecord* record = nullptr;
+
+    ~ThreadHandle() {
+      if (record != nullptr) {
+        record->inUse.store(false, std::memory_order_release);
+      }
+    }
+  };
+
+  EpochRecord* acquire() {
+    for (EpochRecord* r = head_.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+      bool expected = false;
+      if (!r->inUse.load(std::memory_order_relaxed) &&
+          r->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        return r;
+      }
+    }
+    EpochRecord* r = new EpochRecord;
+    r->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(r->next, r, std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+    return r;
+  }
+
+  // advances the global epoch if every active thread has caught up with it
+  bool tryAdvance(std::uint64_t e) {
+    for (EpochRecord* r = head_.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+      if (r->active.load(std::memory_order_seq_cst) &&
+          r->epoch.load(std::memory_order_seq_cst) != e) {
+        return false;
+      }
+    }
+    return global_.compare_exchange_strong(e, e + 1);
+  }
+
+  // frees the limbo lists that are at least two epochs old
+  static void collect(EpochRecord* r, std::uint64_t e) {
+    for (std::size_t i = 0; i < 3; ++i) {
+      if (!r->limbo[i].empty() && r->limboEpoch[i] + 2 <= e) {
+        r->free(i);
+      }
+    }
+  }
+
+ public:
+  ~EpochDomain() {
+    // only reached at exit, when no guard can be open any more
+    EpochRecord* r = head_.load();
+    while (r != nullptr) {
+      EpochRecord* next = r->next;
+      for (std::size_t i = 0; i < 3; ++i) {
+        r->free(i);
+      }
+      delete r;
+      r = next;
+    }
+  }
+
+  static EpochDomain& instance() {
+    static EpochDomain domain;
+    return domain;
+  }
+
+  EpochRecord* record() {
+    thread_local ThreadHandle handle;
+    if (handle.record == nullptr) {
+      handle.record = acquire();
+    }
+    return handle.record;
+  }
+
+  void enter(EpochRecord* r) {
+    if (r->depth++ == 0) {
+      r->epoch.store(global_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+      r->active.store(true, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  void exit(EpochRecord* r) {
+    if (--r->depth == 0) {
+      r->active.store(false, std::memory_order_release);
+    }
+  }
+
+  // p has been unlinked and is freed with destroy once no guard can see it
+  void retire(EpochRecord* r, void* p, void (*destroy)(void*)) {
+    std::uint64_t e = global_.load(std::memory_order_seq_cst);
+    std::size_t i = e % 3;
+    if (r->limboEpoch[i] != e) {
+      // whatever is there was retired at e - 3 or earlier
+      r->free(i);
+      r->limboEpoch[i] = e;
+    }
+    r->limbo[i].push_back({p, destroy});
+
+    if (++r->retiredSinceScan >= kScanInterval) {
+      r->retiredSinceScan = 0;
+      tryAdvance(e);
+      collect(r, global_.load(std::memory_order_seq_cst));
+    }
+  }
+};
+
+// keeps the calling thread inside an epoch for its lifetime
+class EpochGuard {
+ private:
+  EpochRecord* record_;
+
+ public:
+  EpochGuard() : record_(EpochDomain::instance().record()) {
+    EpochDomain::instance().enter(record_);
+  }
+
+  EpochGuard(const EpochGuard&) = delete;
+  EpochGuard& operator=(const EpochGuard&) = delete;
+
+  ~EpochGuard() {
+    EpochDomain::instance().exit(record_);
+  }
+
+  void retire(void* p, void (*destroy)(void*)) {
+    EpochDomain::instance().retire(record_, p, destroy);
+  }
+};
+
+inline std::uint64_t reverseBits(std::uint64_t x) {
+  x = ((x >> 1) & 0x5555'5555'5555'5555ull) | ((x & 0x5555'5555'5555'5555ull) << 1);
+  x = ((x >> 2) & 0x3333'3333'3333'3333ull) | ((x & 0x3333'3333'3333'3333ull) << 2);
+  x = ((x >> 4) & 0x0f0f'0f0f'0f0f'0f0full) | ((x & 0x0f0f'0f0f'0f0f'0f0full) << 4);
+  return __builtin_bswap64(x);
+}
+
+}  // namespace hashset_detail
+
+// Lock-free hash set after Shalev and Shavit's split-ordered lists.  Like
+// ChainedHashSet it keeps every key in one linked list with bucket pointers
+// into it, but the list is a Harris-Michael lock-free list ordered by the
+// bit-reversed hash.  Buckets are then contiguous runs of the list for any
+// power-of-two bucket count, so doubling the table never moves a node: a new
+// bucket is started lazily by splicing a dummy node into its parent's run.
+//
+// insert, contains and erase never block, and neither does growth.  Unlinked
+// nodes are reclaimed with epoch-based reclamation.  The bucket array is a
+// directory of segments that double in size, so it grows without copying.
+template <typename Key, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class LockFreeHashSet {
+ private:
+  // average chain length that doubles the bucket count
+  static constexpr std::size_t kMaxLoad = 2;
+  // segment s holds buckets [2^(s-1), 2^s), segment 0 holds bucket 0
+  static constexpr std::size_t kSegments = 48;
+
+  // the low bit of next marks the node as logically erased
+  struct Node {
+    std::uint64_t soKey;
+    std::atomic<std::uintptr_t> next {0};
+
+    explicit Node(std::uint64_t so) : soKey(so) {}
+  };
+
+  struct KeyNode : Node {
+    Key key;
+
+    KeyNode(std::uint64_t so, const Key& k) : Node(so), key(k) {}
+  };
+
+  using Bucket = std::atomic<Node*>;
+
+  std::array<std::atomic<Bucket*>, kSegments> segments {};
+  std::atomic<std::size_t> bucketCount_;
+  std::atomic<std::size_t> size_;
+  [[no_unique_address]] Hash hash_;
+  [[no_unique_address]] KeyEqual equal_;
+
+  static Node* pointer(std::uintptr_t v) {
+    return reinterpret_cast<Node*>(v & ~std::uintptr_t {1});
+  }
+
+  static bool marked(std::uintptr_t v) {
+    return (v & 1) != 0;
+  }
+
+  static void destroyKeyNode(void* p) {
+    delete static_cast<KeyNode*>(p);
+  }
+
+  // regular keys have the low bit set, dummies have it clear, so a bucket's
+  // dummy sorts before all of its keys
+  static std::uint64_t regularKey(std::uint64_t h) {
+    return hashset_detail::reverseBits(h | (std::uint64_t {1} << 63));
+  }
+
+  static std::uint64_t dummyKey(std::size_t b) {
+    return hashset_detail::reverseBits(b);
+  }
+
+  std::uint64_t hashOf(const Key& key) const {
+    return Pow2MixPolicy::mix(hash_(key));
+  }
+
+  Bucket& slot(std::size_t b);
+
+  // the dummy node of bucket b, inserting it first if needed
+  Node* bucketHead(std::size_t b, hashset_detail::EpochGuard& guard);
+
+  // Positions prev and cur around soKey in the list that starts at head, so
+  // that cur is the first node not ordered before it, unlinking erased nodes
+  // on the way.  Returns whether cur holds soKey (and key, for a regular one).
+  bool find(Node* head, std::uint64_t soKey, const Key* key,
+            std::atomic<std::uintptr_t>*& prev, Node*& cur,
+            hashset_detail::EpochGuard& guard) const;
+
+ public:
+  using key_type = Key;
+  using value_type = Key;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+
+  explicit LockFreeHashSet(const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual());
+
+  LockFreeHashSet(const LockFreeHashSet&) = delete;
+  LockFreeHashSet& operator=(const LockFreeHashSet&) = delete;
+
+  // must not run concurrently with any other operation
+  ~LockFreeHashSet();
+
+  // return whether key was inserted
+  bool insert(const Key& key);
+
+  bool contains(const Key& key) const;
+
+  // return whether key was erased
+  bool erase(const Key& key);
+
+  // return the number of elements at some recent point
+  std::size_t size() const;
+
+  bool empty() const;
+
+  // return the current number of buckets, always a power of two
+  std::size_t bucketCount() const;
+
+  // calls f(key) for every element in split order.  Concurrent inserts and
+  // erases may or may not be seen.
+  template <typename F>
+  void forEach(F f) const;
+};
+
+
+template <typename Key, typename Hash, typename KeyEqual>
+LockFreeHashSet<Key, Hash, KeyEqual>::LockFreeHashSet(const Hash& hash, const KeyEqual& equal)
+    : bucketCount_(2), size_(0), hash_(hash), equal_(equal) {
+  slot(0).store(new Node(dummyKey(0)));
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+LockFreeHashSet<Key, Hash, KeyEqual>::~LockFreeHashSet() {
+  Node* n = slot(0).load();
+  while (n != nullptr) {
+    Node* next = pointer(n->next.load());
+    if (n->soKey & 1) {
+      delete static_cast<KeyNode*>(n);
+    }
+    else {
+      delete n;
+    }
+    n = next;
+  }
+  for (auto& segment : segments) {
+    delete[] segment.load();
+  }
+}
+
+// Segments are allocated on first use.  Racing threads each allocate one and
+// the losers free theirs.
+template <typename Key, typename Hash, typename KeyEqual>
+auto LockFreeHashSet<Key, Hash, KeyEqual>::slot(std::size_t b) -> Bucket& {
+  std::size_t s = std::bit_width(b);
+  std::size_t base = (s == 0) ? 0 : (std::size_t {1} << (s - 1));
+  Bucket* segment = segments[s].load(std::memory_order_acquire);
+  if (segment == nullptr) {
+    std::size_t n = (s == 0) ? 1 : (std::size_t {1} << (s - 1));
+    Bucket* fresh = new Bucket[n]();
+    if (segments[s].compare_exchange_strong(segment, fresh, std::memory_order_acq_rel)) {
+      segment = fresh;
+    }
+    else {
+      delete[] fresh;
+    }
+  }
+  return segment[b - base];
+}
+
+// A bucket's parent is the bucket it was split from, b without its top bit.
+// The parent's run contains the place of b's dummy.
+template <typename Key, typename Hash, typename KeyEqual>
+auto LockFreeHashSet<Key, Hash, KeyEqual>::bucketHead(std::size_t b, hashset_detail::EpochGuard& guard)
+    -> Node* {
+  Bucket& bucket = slot(b);
+  Node* head = bucket.load(std::memory_order_acquire);
+  if (head != nullptr) {
+    return head;
+  }
+
+  std::size_t parent = b & ~(std::size_t {1} << (std::bit_width(b) - 1));
+  Node* parentHead = bucketHead(parent, guard);
+
+  Node* dummy = new Node(dummyKey(b));
+  std::atomic<std::uintptr_t>* prev;
+  Node* cur;
+  for (;;) {
+    if (find(parentHead, dummy->soKey, nullptr, prev, cur, guard)) {
+      delete dummy;
+      dummy = cur;
+      break;
+    }
+    dummy->next.store(reinterpret_cast<std::uintptr_t>(cur), std::memory_order_relaxed);
+    std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(cur);
+    if (prev->compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(dummy))) {
+      break;
+    }
+  }
+  bucket.store(dummy, std::memory_order_release);
+  return dummy;
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+bool LockFreeHashSet<Key, Hash, KeyEqual>::find(
+    Node* head, std::uint64_t soKey, const Key* key, std::atomic<std::uintptr_t>*& prev,
+    Node*& cur, hashset_detail::EpochGuard& guard) const {
+retry:
+  prev = &head->next;
+  cur = pointer(prev->load());
+  while (cur != nullptr) {
+    std::uintptr_t next = cur->next.load();
+    if (prev->load() != reinterpret_cast<std::uintptr_t>(cur)) {
+      goto retry;
+    }
+
+    if (marked(next)) {
+      std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(cur);
+      if (!prev->compare_exchange_strong(expected, next & ~std::uintptr_t {1})) {
+        goto retry;
+      }
+      // only regular nodes are ever erased
+      guard.retire(static_cast<KeyNode*>(cur), &destroyKeyNode);
+      cur = pointer(next);
+      continue;
+    }
+
+    if (cur->soKey > soKey) {
+      return false;
+    }
+    if (cur->soKey == soKey &&
+        (key == nullptr || equal_(static_cast<KeyNode*>(cur)->key, *key))) {
+      return true;
+    }
+    prev = &cur->next;
+    cur = pointer(next);
+  }
+  return false;
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+bool LockFreeHashSet<Key, Hash, KeyEqual>::insert(const Key& key) {
+  hashset_detail::EpochGuard guard;
+  std::uint64_t h = hashOf(key);
+  std::uint64_t so = regularKey(h);
+  Node* head = bucketHead(h & (bucketCount_.load(std::memory_order_acquire) - 1), guard);
+
+  KeyNode* node = nullptr;
+  std::atomic<std::uintptr_t>* prev;
+  Node* cur;
+  for (;;) {
+    if (find(head, so, &key, prev, cur, guard)) {
+      delete node;
+      return false;
+    }
+    if (node == nullptr) {
+      node = new KeyNode(so, key);
+    }
+    node->next.store(reinterpret_cast<std::uintptr_t>(cur), std::memory_order_relaxed);
+    std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(cur);
+    if (prev->compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(node))) {
+      break;
+    }
+  }
+
+// Growing only publishes the larger count; the new buckets fill in lazily.
+  std::size_t n = size_.fetch_add(1) + 1;
+  std::size_t count = bucketCount_.load(std::memory_order_relaxed);
+  if (n > count * kMaxLoad && std::bit_width(count) < kSegments) {
+    bucketCount_.compare_exchange_strong(count, count * 2);
+  }
+  return true;
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+bool LockFreeHashSet<Key, Hash, KeyEqual>::contains(const Key& key) const {
+  hashset_detail::EpochGuard guard;
+  std::uint64_t h = hashOf(key);
+  auto* self = const_cast<LockFreeHashSet*>(this);
+  Node* head = self->bucketHead(h & (bucketCount_.load(std::memory_order_acquire) - 1), guard);
+  std::atomic<std::uintptr_t>* prev;
+  Node* cur;
+  return find(head, regularKey(h), &key, prev, cur, guard);
+}
+
+// Erasing marks the node first, which is the linearization point, and then
+// tries to unlink it.  If that fails, a find() does the unlinking for us.
+template <typename Key, typename Hash, typename KeyEqual>
+bool LockFreeHashSet<Key, Hash, KeyEqual>::erase(const Key& key) {
+  hashset_detail::EpochGuard guard;
+  std::uint64_t h = hashOf(key);
+  std::uint64_t so = regularKey(h);
+  Node* head = bucketHead(h & (bucketCount_.load(std::memory_order_acquire) - 1), guard);
+
+  std::atomic<std::uintptr_t>* prev;
+  Node* cur;
+  for (;;) {
+    if (!find(head, so, &key, prev, cur, guard)) {
+      return false;
+    }
+    std::uintptr_t next = cur->next.load();
+    if (marked(next)) {
+      continue;
+    }
+    if (!cur->next.compare_exchange_strong(next, next | 1)) {
+      continue;
+    }
+    size_.fetch_sub(1);
+
+    std::uintptr_t expected = reinterpret_cast<std::uintptr_t>(cur);
+    if (prev->compare_exchange_strong(expected, next)) {
+      guard.retire(static_cast<KeyNode*>(cur), &destroyKeyNode);
+    }
+    else {
+      find(head, so, &key, prev, cur, guard);
+    }
+    return true;
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+std::size_t LockFreeHashSet<Key, Hash, KeyEqual>::size() const {
+  return size_.load();
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+bool LockFreeHashSet<Key, Hash, KeyEqual>::empty() const {
+  return size() == 0;
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+std::size_t LockFreeHashSet<Key, Hash, KeyEqual>::bucketCount() const {
+  return bucketCount_.load();
+}
+
+template <typename Key, typename Hash, typename KeyEqual>
+template <typename F>
+void LockFreeHashSet<Key, Hash, KeyEqual>::forEach(F f) const {
+  hashset_detail::EpochGuard guard;
+  Node* n = const_cast<LockFreeHashSet*>(this)->slot(0).load(std::memory_order_acquire);
+  while (n != nullptr) {
+    std::uintptr_t next = n->next.load();
+    if ((n->soKey & 1) && !marked(next)) {
+      f(static_cast<const KeyNode*>(n)->key);
+    }
+    n = pointer(next);
+  }
+}
+
+#endif      // LOCKFREE_HASH_HPP_
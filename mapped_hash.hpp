@@ -0,0 +1,454 @@
+#ifndef MAPPED_HASH_HPP_
+#define MAPPED_HASH_HPP_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bucket_policy.hpp"
+
+// On-disk snapshots of a hash set, written by save() on either backend and
+// queried in place through MappedHashSet.  The file holds no pointers: the
+// keys are stored grouped by bucket, and bucket b owns keys
+// [starts[b], starts[b + 1]), so a mapped file is usable as it is.
+//
+//   offset 0          SnapshotHeader
+//   offsetsAt         bucketCount + 1 start indices, std::uint64_t
+//   keysAt            size keys, bucket by bucket
+//
+// Sections start on 64-byte boundaries and the file is padded to a multiple
+// of 8 bytes.  The checksum covers the whole file except its own field.
+// Integers and keys are stored in the byte order of the machine that wrote
+// them, and the reader must use the same Hash and BucketPolicy as the writer.
+
+namespace hashset_detail {
+
+struct SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byteOrder;
+  std::uint64_t keySize;
+  std::uint64_t keyAlign;
+  std::uint64_t bucketCount;
+  std::uint64_t size;
+  std::uint64_t offsetsAt;
+  std::uint64_t keysAt;
+  std::uint64_t fileSize;
+  std::uint64_t checksum;
+};
+
+inline constexpr char kSnapshotMagic[8] {'H', 'S', 'E', 'T', 'S', 'N', 'A', 'P'};
+inline constexpr std::uint32_t kSnapshotVersion = 1;
+inline constexpr std::uint32_t kSnapshotByteOrder = 0x0102'0304;
+inline constexpr std::size_t kSnapshotAlign = 64;
+
+inline std::size_t alignUp(std::size_t n, std::size_t align) {
+  return (n + align - 1) / align * align;
+}
+
+// A 64-bit word-at-a-time hash of [data, data + words * 8).  Four lanes run
+// side by side so that the multiplies do not wait on each other, which keeps
+// verification close to memory bandwidth.
+inline std::uint64_t snapshotChecksum(const std::byte* data, std::size_t words) {
+  constexpr std::uint64_t kMul = 0x9e37'79b9'7f4a'7c15ull;
+  std::uint64_t lanes[4] {1, 2, 3, 4};
+  std::size_t i = 0;
+  for (; i + 4 <= words; i += 4) {
+    for (std::size_t l = 0; l < 4; ++l) {
+      std::uint64_t w;
+      std::memcpy(&w, data + (i + l) * 8, 8);
+      lanes[l] = (lanes[l] ^ w) * kMul;
+      lanes[l] ^= lanes[l] >> 29;
+    }
+  }
+  for (; i < words; ++i) {
+    std::uint64_t w;
+    std::memcpy(&w, data + i * 8, 8);
+    lanes[0] = (lanes[0] ^ w) * kMul;
+    lanes[0] ^= lanes[0] >> 29;
+  }
+  std::uint64_t h = words;
+  for (std::uint64_t lane : lanes) {
+    h = (h ^ lane) * kMul;
+    h ^= h >> 32;
+  }
+  return h;
+}
+
+// checksum of a whole snapshot: the header up to the checksum field, which
+// is its last member, and everything after the header
+inline std::uint64_t snapshotDigest(const std::byte* base, std::size_t fileSize) {
+  static_assert(offsetof(SnapshotHeader, checksum) + 8 == sizeof(SnapshotHeader));
+  std::uint64_t head = snapshotChecksum(base, offsetof(SnapshotHeader, checksum) / 8);
+  std::uint64_t body = snapshotChecksum(base + sizeof(SnapshotHeader),
+                                        (fileSize - sizeof(SnapshotHeader)) / 8);
+  return (head ^ body) * 0x9e37'79b9'7f4a'7c15ull + body;
+}
+
+[[noreturn]] inline void throwErrno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Owns a file descriptor until it is closed or goes out of scope.
+class FileHandle {
+ private:
+  int fd_;
+
+ public:
+  explicit FileHandle(int fd) : fd_(fd) {}
+
+  FileHandle(const FileHandle&) = delete;
+  FileHandle& operator=(const FileHandle&) = delete;
+
+  ~FileHandle() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  int get() const {
+    return fd_;
+  }
+};
+
+// Writes a snapshot of size keys in bucketCount buckets.  forEach(f) must call
+// f(key) once for every key, and is called twice: once to count the keys of
+// each bucket and once to place them.  The file is built under a temporary
+// name and renamed over path when complete, so readers never see a partial
+// snapshot.
+template <typename Key, typename ForEach, typename BucketOf>
+void writeSnapshot(const std::string& path, std::size_t bucketCount, std::size_t size,
+                   ForEach forEach, BucketOf bucketOf) {
+  static_assert(std::is_trivially_copyable_v<Key>,
+                "snapshots store keys as raw bytes, so Key must be trivially copyable");
+
+  std::size_t offsetsAt = alignUp(sizeof(SnapshotHeader), kSnapshotAlign);
+  std::size_t keysAt = alignUp(offsetsAt + (bucketCount + 1) * sizeof(std::uint64_t), kSnapshotAlign);
+  std::size_t fileSize = alignUp(keysAt + size * sizeof(Key), sizeof(std::uint64_t));
+
+  std::string tmp = path + ".tmp";
+  FileHandle file {::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)};
+  if (file.get() < 0) {
+    throwErrno("cannot create " + tmp);
+  }
+  // removes the temporary file, then reports errno as it was
+  auto fail = [&tmp](const std::string& what) {
+    int error = errno;
+    ::unlink(tmp.c_str());
+    errno = error;
+    throwErrno(what);
+  };
+  if (::ftruncate(file.get(), static_cast<off_t>(fileSize)) != 0) {
+    fail("cannot resize " + tmp);
+  }
+  void* map = ::mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file.get(), 0);
+  if (map == MAP_FAILED) {
+    fail("cannot map " + tmp);
+  }
+  auto* base = static_cast<std::byte*>(map);
+
+  // A counting sort by bucket: starts[b + 1] counts bucket b, the prefix sum
+  // turns the counts into start indices, and fill hands out the slots.
+  auto* starts = reinterpret_cast<std::uint64_t*>(base + offsetsAt);
+  auto* keys = reinterpret_cast<Key*>(base + keysAt);
+  try {
+    forEach([&](const Key& key) { starts[bucketOf(key) + 1]++; });
+    for (std::size_t b = 0; b < bucketCount; ++b) {
+      starts[b + 1] += starts[b];
+    }
+    std::vector<std::uint64_t> fill(starts, starts + bucketCount);
+    forEach([&](const Key& key) { std::memcpy(&keys[fill[bucketOf(key)]++], &key, sizeof(Key)); });
+  }
+  catch (...) {
+    ::munmap(map, fileSize);
+    ::unlink(tmp.c_str());
+    throw;
+  }
+
+  SnapshotHeader header {};
+  std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+  header.version = kSnapshotVersion;
+  header.byteOrder = kSnapshotByteOrder;
+  header.keySize = sizeof(Key);
+  header.keyAlign = alignof(Key);
+  header.bucketCount = bucketCount;
+  header.size = size;
+  header.offsetsAt = offsetsAt;
+  header.keysAt = keysAt;
+  header.fileSize = fileSize;
+  std::memcpy(base, &header, sizeof(header));
+  header.checksum = snapshotDigest(base, fileSize);
+  std::memcpy(base, &header, sizeof(header));
+
+  ::munmap(map, fileSize);
+  if (::fsync(file.get()) != 0) {
+    fail("cannot sync " + tmp);
+  }
+  if (::rename(tmp.c_str(), path.c_str()) != 0) {
+    fail("cannot rename " + tmp + " to " + path);
+  }
+}
+
+}  // namespace hashset_detail
+
+// A read-only set backed by a snapshot file mapped into memory.  Opening it
+// checks the header and, unless told not to, the checksum; after that nothing
+// is copied or rebuilt, and pages are read in by the first lookups that touch
+// them.  Iteration runs through the keys in bucket order.
+template <typename Key, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename BucketPolicy = PrimeModPolicy>
+class MappedHashSet {
+ private:
+  const std::byte* base_;
+  std::size_t length_;
+  const std::uint64_t* starts;
+  const Key* keys;
+  std::size_t bucketCount_;
+  std::size_t size_;
+  BucketPolicy policy_;
+  [[no_unique_address]] Hash hash_;
+  [[no_unique_address]] KeyEqual equal_;
+
+  void unmap();
+
+ public:
+  using Iterator = const Key*;
+  using key_type = Key;
+  using value_type = Key;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+
+  // maps the snapshot at path.  Throws std::system_error if the file cannot
+  // be read and std::runtime_error if it is not a valid snapshot for this
+  // Key and BucketPolicy.  verify = false skips the checksum, which reads the
+  // whole file; the snapshot is then trusted as it is.
+  explicit MappedHashSet(const std::string& path, bool verify = true,
+                         const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual());
+
+  MappedHashSet(MappedHashSet&& other);
+  MappedHashSet& operator=(MappedHashSet other);
+
+  ~MappedHashSet();
+
+  bool contains(const Key& key) const;
+
+  // pointer to the stored key, or end()
+  Iterator find(const Key& key) const;
+
+  std::size_t size() const;
+
+  bool empty() const;
+
+  std::size_t bucketCount() const;
+
+  std::size_t bucketSize(std::size_t b) const;
+
+  std::size_t bucket(const Key& key) const;
+
+  float loadFactor() const;
+
+  Iterator begin() const;
+
+  Iterator end() const;
+};
+
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::MappedHashSet(
+    const std::string& path, bool verify, const Hash& hash, const KeyEqual& equal)
+    : base_(nullptr), length_(0), starts(nullptr), keys(nullptr), bucketCount_(0),
+      size_(0), hash_(hash), equal_(equal) {
+  static_assert(std::is_trivially_copyable_v<Key>,
+                "snapshots store keys as raw bytes, so Key must be trivially copyable");
+  using hashset_detail::SnapshotHeader;
+
+  hashset_detail::FileHandle file {::open(path.c_str(), O_RDONLY)};
+  if (file.get() < 0) {
+    hashset_detail::throwErrno("cannot open " + path);
+  }
+  struct stat st {};
+  if (::fstat(file.get(), &st) != 0) {
+    hashset_detail::throwErrno("cannot stat " + path);
+  }
+  auto fileSize = static_cast<std::size_t>(st.st_size);
+  if (fileSize < sizeof(SnapshotHeader)) {
+    throw std::runtime_error(path + ": too short for a snapshot");
+  }
+
+  void* map = ::mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, file.get(), 0);
+  if (map == MAP_FAILED) {
+    hashset_detail::throwErrno("cannot map " + path);
+  }
+  base_ = static_cast<const std::byte*>(map);
+  length_ = fileSize;
+
+  // Every check is made before the policy is built or a section is touched,
+  // so a damaged header cannot send a lookup outside the mapping.
+  try {
+    SnapshotHeader header;
+    std::memcpy(&header, base_, sizeof(header));
+    if (std::memcmp(header.magic, hashset_detail::kSnapshotMagic, sizeof(header.magic)) != 0) {
+      throw std::runtime_error(path + ": not a hash set snapshot");
+    }
+    if (header.version != hashset_detail::kSnapshotVersion) {
+      throw std::runtime_error(path + ": unsupported snapshot version " +
+                               std::to_string(header.version));
+    }
+    if (header.byteOrder != hashset_detail::kSnapshotByteOrder) {
+      throw std::runtime_error(path + ": snapshot written with another byte order");
+    }
+    if (header.keySize != sizeof(Key) || header.keyAlign != alignof(Key)) {
+      throw std::runtime_error(path + ": snapshot holds keys of another type");
+    }
+    auto& sizes = BucketPolicy::sizes;
+    if (std::find(sizes.begin(), sizes.end(), header.bucketCount) == sizes.end()) {
+      throw std::runtime_error(path + ": snapshot written with another bucket policy");
+    }
+    // whether count items of width bytes fit in the file from offset at on
+    auto fits = [fileSize](std::size_t at, std::size_t count, std::size_t width) {
+      return at <= fileSize && (fileSize - at) / width >= count;
+    };
+    if (header.fileSize != fileSize || fileSize % 8 != 0 ||
+        header.offsetsAt < sizeof(SnapshotHeader) || header.offsetsAt % 8 != 0 ||
+        !fits(header.offsetsAt, header.bucketCount + 1, sizeof(std::uint64_t)) ||
+        header.keysAt < header.offsetsAt + (header.bucketCount + 1) * sizeof(std::uint64_t) ||
+        header.keysAt % alignof(Key) != 0 || !fits(header.keysAt, header.size, sizeof(Key))) {
+      throw std::runtime_error(path + ": snapshot is truncated or its layout is damaged");
+    }
+    if (verify && hashset_detail::snapshotDigest(base_, fileSize) != header.checksum) {
+      throw std::runtime_error(path + ": snapshot checksum mismatch");
+    }
+
+    starts = reinterpret_cast<const std::uint64_t*>(base_ + header.offsetsAt);
+    // every bucket must end where the next one starts, or a lookup could
+    // walk past the keys
+    bool sorted = starts[0] == 0 && starts[header.bucketCount] == header.size;
+    for (std::size_t b = 0; sorted && b < header.bucketCount; ++b) {
+      sorted = starts[b] <= starts[b + 1];
+    }
+    if (!sorted) {
+      throw std::runtime_error(path + ": snapshot bucket index is damaged");
+    }
+    keys = reinterpret_cast<const Key*>(base_ + header.keysAt);
+    bucketCount_ = header.bucketCount;
+    size_ = header.size;
+    policy_ = BucketPolicy(bucketCount_);
+  }
+  catch (...) {
+    unmap();
+    throw;
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::MappedHashSet(MappedHashSet&& other)
+    : base_(std::exchange(other.base_, nullptr)), length_(std::exchange(other.length_, 0)),
+      starts(other.starts), keys(other.keys), bucketCount_(other.bucketCount_),
+      size_(std::exchange(other.size_, 0)), policy_(other.policy_),
+      hash_(other.hash_), equal_(other.equal_) {
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+auto MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::operator=(MappedHashSet other)
+    -> MappedHashSet& {
+  std::swap(base_, other.base_);
+  std::swap(length_, other.length_);
+  std::swap(starts, other.starts);
+  std::swap(keys, other.keys);
+  std::swap(bucketCount_, other.bucketCount_);
+  std::swap(size_, other.size_);
+  std::swap(policy_, other.policy_);
+  std::swap(hash_, other.hash_);
+  std::swap(equal_, other.equal_);
+  return *this;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::~MappedHashSet() {
+  unmap();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+void MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::unmap() {
+  if (base_ != nullptr) {
+    ::munmap(const_cast<std::byte*>(base_), length_);
+    base_ = nullptr;
+  }
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+auto MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::find(const Key& key) const -> Iterator {
+  if (size_ == 0) {
+    return end();
+  }
+  std::size_t b = bucket(key);
+  for (const Key* it = keys + starts[b]; it != keys + starts[b + 1]; ++it) {
+    if (equal_(*it, key)) {
+      return it;
+    }
+  }
+  return end();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+bool MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::contains(const Key& key) const {
+  return find(key) != end();
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+std::size_t MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::size() const {
+  return size_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+bool MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::empty() const {
+  return size_ == 0;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+std::size_t MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::bucketCount() const {
+  return bucketCount_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+std::size_t MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::bucketSize(std::size_t b) const {
+  if (b >= bucketCount_) {
+    return 0;
+  }
+  return starts[b + 1] - starts[b];
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+std::size_t MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::bucket(const Key& key) const {
+  return policy_.index(hash_(key));
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+float MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::loadFactor() const {
+  return (bucketCount_ == 0) ? 0.0f : static_cast<float>(size_) / bucketCount_;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+auto MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::begin() const -> Iterator {
+  return keys;
+}
+
+template <typename Key, typename Hash, typename KeyEqual, typename BucketPolicy>
+auto MappedHashSet<Key, Hash, KeyEqual, BucketPolicy>::end() const -> Iterator {
+  return keys + size_;
+}
+
+#endif      // MAPPED_HASH_HPP_
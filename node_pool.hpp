@@ -0,0 +1,229 @@
+#ifndef NODE_POOL_HPP_
+#define NODE_POOL_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size block allocator.  Blocks are carved out of slabs that grow
+// geometrically, and freed blocks go on an intrusive free list so that the
+// next allocation reuses the most recently freed block.  Not thread safe.
+class NodePool {
+ private:
+  static constexpr std::size_t kFirstSlab = 32;
+  static constexpr std::size_t kMaxSlab = 4'096;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  std::size_t blockSize_;
+  std::size_t nextSlab_;
+  std::vector<void*> slabs;
+  FreeBlock* free_;
+  // unused tail of the newest slab
+  char* bump_;
+  char* bumpEnd_;
+  std::size_t live_;
+
+  // starts a slab of the given number of blocks.  What is left of the current
+  // one goes on the free list.
+  void addSlab(std::size_t blocks) {
+    for (; bump_ != bumpEnd_; bump_ += blockSize_) {
+      FreeBlock* b = reinterpret_cast<FreeBlock*>(bump_);
+      b->next = free_;
+      free_ = b;
+    }
+    bump_ = static_cast<char*>(::operator new(blocks * blockSize_));
+    bumpEnd_ = bump_ + blocks * blockSize_;
+    slabs.push_back(bump_);
+  }
+
+ public:
+  explicit NodePool(std::size_t blockSize)
+      : blockSize_(std::max(blockSize, sizeof(FreeBlock))), nextSlab_(kFirstSlab),
+        free_(nullptr), bump_(nullptr), bumpEnd_(nullptr), live_(0) {}
+
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+  ~NodePool() {
+    for (void* slab : slabs) {
+      ::operator delete(slab);
+    }
+  }
+
+  void* allocate() {
+    live_++;
+    if (free_ != nullptr) {
+      FreeBlock* b = free_;
+      free_ = b->next;
+      return b;
+    }
+    if (bump_ == bumpEnd_) {
+      addSlab(nextSlab_);
+      nextSlab_ = std::min(nextSlab_ * 2, kMaxSlab);
+    }
+    void* p = bump_;
+    bump_ += blockSize_;
+    return p;
+  }
+
+  void deallocate(void* p) {
+    live_--;
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    b->next = free_;
+    free_ = b;
+  }
+
+  // makes room for n more blocks with at most one call to operator new
+  void reserve(std::size_t n) {
+    if (static_cast<std::size_t>(bumpEnd_ - bump_) / blockSize_ < n) {
+      addSlab(n);
+    }
+  }
+
+  // frees every slab at once instead of keeping the blocks for reuse.  Only
+  // does something when no block is live.
+  bool release() {
+    if (live_ != 0) {
+      return false;
+    }
+    for (void* slab : slabs) {
+      ::operator delete(slab);
+    }
+    slabs.clear();
+    free_ = nullptr;
+    bump_ = bumpEnd_ = nullptr;
+    nextSlab_ = kFirstSlab;
+    return true;
+  }
+
+  std::size_t blockSize() const {
+    return blockSize_;
+  }
+
+  std::size_t slabCount() const {
+    return slabs.size();
+  }
+
+  std::size_t liveBlocks() const {
+    return live_;
+  }
+};
+
+// One pool per block size, shared by all the rebound copies of a
+// PoolAllocator.  A container usually needs a single size, for its nodes.
+class PoolResource {
+ private:
+  std::vector<std::unique_ptr<NodePool>> pools;
+
+ public:
+  NodePool& poolFor(std::size_t blockSize) {
+    for (auto& pool : pools) {
+      if (pool->blockSize() == blockSize) {
+        return *pool;
+      }
+    }
+    pools.push_back(std::make_unique<NodePool>(blockSize));
+    return *pools.back();
+  }
+
+  // releases the slabs of every pool without live blocks, e.g. after clear()
+  void release() {
+    for (auto& pool : pools) {
+      pool->release();
+    }
+  }
+
+  // number of slabs obtained from operator new and still held
+  std::size_t slabCount() const {
+    std::size_t c = 0;
+    for (const auto& pool : pools) {
+      c += pool->slabCount();
+    }
+    return c;
+  }
+};
+
+// Allocator for node-based containers such as ChainedHashSet.  Single-object
+// allocations, which is every list node, come from a NodePool.  Arrays, such
+// as the bucket vector, go straight to operator new.  A default-constructed
+// allocator owns a fresh resource.  Copies share it, so the slabs are freed
+// all at once when the last container using them is destroyed.  A container
+// that is copied gets a fresh resource for the copy.
+template <typename T>
+class PoolAllocator {
+ private:
+  template <typename U>
+  friend class PoolAllocator;
+
+  std::shared_ptr<PoolResource> resource_;
+
+  static constexpr std::size_t blockSize() {
+    return (sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T);
+  }
+
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "PoolAllocator does not support over-aligned types");
+
+ public:
+  using value_type = T;
+  // the sets swap and assign their lists wholesale, so the pool has to
+  // travel with the nodes
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  PoolAllocator() : resource_(std::make_shared<PoolResource>()) {}
+
+  // copies on move as well: a moved-from allocator must still compare equal
+  PoolAllocator(const PoolAllocator&) = default;
+  PoolAllocator& operator=(const PoolAllocator&) = default;
+
+  explicit PoolAllocator(std::shared_ptr<PoolResource> resource)
+      : resource_(std::move(resource)) {}
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) : resource_(other.resource_) {}
+
+  PoolAllocator select_on_container_copy_construction() const {
+    return PoolAllocator();
+  }
+
+  T* allocate(std::size_t n) {
+    if (n == 1) {
+      return static_cast<T*>(resource_->poolFor(blockSize()).allocate());
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) {
+    if (n == 1) {
+      resource_->poolFor(blockSize()).deallocate(p);
+    }
+    else {
+      ::operator delete(p);
+    }
+  }
+
+  // the next n single-object allocations of a T are carved from one slab;
+  // other block sizes sharing the resource are left alone
+  void reserve(std::size_t n) {
+    resource_->poolFor(blockSize()).reserve(n);
+  }
+
+  const std::shared_ptr<PoolResource>& resource() const {
+    return resource_;
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>& other) const {
+    return resource_ == other.resource_;
+  }
+};
+
+#endif      // NODE_POOL_HPP_
@@ -0,0 +1,613 @@
+#ifndef ROARING_SET_HPP_
+#define ROARING_SET_HPP_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hashset_detail {
+
+// The keys of one chunk of 2^16 values, stored as their low 16 bits in one of
+// three forms: a sorted array while there are few, a bitmap of the whole
+// chunk once there are many, and sorted runs of consecutive values when
+// those take less room than either.
+class RoaringContainer {
+ public:
+  enum class Kind { kArray, kBitmap, kRun };
+
+  // arrays above this size take more room than a bitmap
+  static constexpr std::size_t kArrayMax = 4096;
+  static constexpr std::size_t kBitmapWords = (1 << 16) / 64;
+  // what next() returns past the last value
+  static constexpr std::uint32_t kEnd = 1 << 16;
+
+ private:
+  struct Run {
+    std::uint16_t first;
+    std::uint16_t last;
+  };
+
+  Kind kind_ = Kind::kArray;
+  std::uint32_t size_ = 0;
+  // only the vector of the current kind holds anything
+  std::vector<std::uint16_t> values_;
+  std::vector<std::uint64_t> bits_;
+  std::vector<Run> runs_;
+
+  static std::uint64_t bitOf(std::uint32_t low) {
+    return std::uint64_t {1} << (low % 64);
+  }
+
+  // the first run that ends at or after low
+  std::size_t runAtOrAfter(std::uint32_t low) const {
+    return std::partition_point(runs_.begin(), runs_.end(),
+                                [low](const Run& run) { return run.last < low; }) -
+           runs_.begin();
+  }
+
+  std::size_t countRuns() const {
+    switch (kind_) {
+      case Kind::kArray: {
+        std::size_t runs = 0;
+        for (std::size_t i = 0; i < values_.size(); ++i) {
+          runs += i == 0 || values_[i] != values_[i - 1] + 1;
+        }
+        return runs;
+      }
+      case Kind::kBitmap: {
+        // a run starts at every set bit whose lower neighbour is clear
+        std::size_t runs = 0;
+        std::uint64_t carry = 0;
+        for (std::uint64_t word : bits_) {
+          runs += std::popcount(word & ~((word << 1) | carry));
+          carry = word >> 63;
+        }
+        return runs;
+      }
+      case Kind::kRun:
+        break;
+    }
+    return runs_.size();
+  }
+
+  // calls f(first, last) for every run of consecutive values, in order
+  template <typename F>
+  void forEachRun(F f) const {
+    switch (kind_) {
+      case Kind::kArray:
+        for (std::size_t i = 0; i < values_.size(); ) {
+          std::size_t j = i;
+          while (j + 1 < values_.size() && values_[j + 1] == values_[j] + 1) {
+            ++j;
+          }
+          f(values_[i], values_[j]);
+          i = j + 1;
+        }
+        break;
+      case Kind::kBitmap:
+        for (std::uint32_t low = next(0); low != kEnd; ) {
+          std::uint32_t last = low;
+          while (last + 1 < kEnd && (bits_[(last + 1) / 64] & bitOf(last + 1))) {
+            ++last;
+          }
+          f(low, last);
+          low = last + 1 < kEnd ? next(last + 1) : kEnd;
+        }
+        break;
+      case Kind::kRun:
+        for (const Run& run : runs_) {
+          f(run.first, run.last);
+        }
+        break;
+    }
+  }
+
+  void toArray() {
+    std::vector<std::uint16_t> values;
+    values.reserve(size_);
+    forEachRun([&values](std::uint32_t first, std::uint32_t last) {
+      for (std::uint32_t v = first; v <= last; ++v) {
+        values.push_back(static_cast<std::uint16_t>(v));
+      }
+    });
+    values_ = std::move(values);
+    std::vector<std::uint64_t>().swap(bits_);
+    std::vector<Run>().swap(runs_);
+    kind_ = Kind::kArray;
+  }
+
+  void toBitmap() {
+    std::vector<std::uint64_t> bits(kBitmapWords, 0);
+    forEachRun([&bits](std::uint32_t first, std::uint32_t last) {
+      for (std::uint32_t v = first; v <= last; ++v) {
+        bits[v / 64] |= bitOf(v);
+      }
+    });
+    bits_ = std::move(bits);
+    std::vector<std::uint16_t>().swap(values_);
+    std::vector<Run>().swap(runs_);
+    kind_ = Kind::kBitmap;
+  }
+
+  void toRuns() {
+    std::vector<Run> runs;
+    runs.reserve(countRuns());
+    forEachRun([&runs](std::uint32_t first, std::uint32_t last) {
+      runs.push_back({static_cast<std::uint16_t>(first), static_cast<std::uint16_t>(last)});
+    });
+    runs_ = std::move(runs);
+    std::vector<std::uint16_t>().swap(values_);
+    std::vector<std::uint64_t>().swap(bits_);
+    kind_ = Kind::kRun;
+  }
+
+  // after a run was split or added: leave the run form once it is larger
+  // than the one the keys would otherwise take
+  void fitRuns() {
+    std::size_t other = size_ <= kArrayMax ? size_ * sizeof(std::uint16_t)
+                                           : kBitmapWords * sizeof(std::uint64_t);
+    if (runs_.size() * sizeof(Run) > other) {
+      if (size_ <= kArrayMax) {
+        toArray();
+      }
+      else {
+        toBitmap();
+      }
+    }
+  }
+
+ public:
+  Kind kind() const {
+    return kind_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // the heap memory held, in bytes
+  std::size_t bytes() const {
+    return values_.capacity() * sizeof(std::uint16_t) + bits_.capacity() * sizeof(std::uint64_t) +
+           runs_.capacity() * sizeof(Run);
+  }
+
+  bool contains(std::uint32_t low) const {
+    switch (kind_) {
+      case Kind::kArray:
+        return std::binary_search(values_.begin(), values_.end(), low);
+      case Kind::kBitmap:
+        return (bits_[low / 64] & bitOf(low)) != 0;
+      case Kind::kRun:
+        break;
+    }
+    std::size_t i = runAtOrAfter(low);
+    return i < runs_.size() && runs_[i].first <= low;
+  }
+
+  // the smallest value at or above low, or kEnd
+  std::uint32_t next(std::uint32_t low) const {
+    switch (kind_) {
+      case Kind::kArray: {
+        auto it = std::lower_bound(values_.begin(), values_.end(), low);
+        return it == values_.end() ? kEnd : *it;
+      }
+      case Kind::kBitmap: {
+        std::size_t w = low / 64;
+        if (w >= kBitmapWords) {
+          return kEnd;
+        }
+        std::uint64_t word = bits_[w] & (~std::uint64_t {0} << (low % 64));
+        while (word == 0) {
+          if (++w == kBitmapWords) {
+            return kEnd;
+          }
+          word = bits_[w];
+        }
+        return static_cast<std::uint32_t>(w * 64 + std::countr_zero(word));
+      }
+      case Kind::kRun:
+        break;
+    }
+    std::size_t i = runAtOrAfter(low);
+    return i == runs_.size() ? kEnd : std::max<std::uint32_t>(runs_[i].first, low);
+  }
+
+  // return whether low was inserted
+  bool insert(std::uint32_t low) {
+    switch (kind_) {
+      case Kind::kArray: {
+        auto it = std::lower_bound(values_.begin(), values_.end(), low);
+        if (it != values_.end() && *it == low) {
+          return false;
+        }
+        if (size_ == kArrayMax) {
+          toBitmap();
+          return insert(low);
+        }
+        values_.insert(it, static_cast<std::uint16_t>(low));
+        size_++;
+        return true;
+      }
+      case Kind::kBitmap: {
+        std::uint64_t& word = bits_[low / 64];
+        if (word & bitOf(low)) {
+          return false;
+        }
+        word |= bitOf(low);
+        // a full chunk is a single run
+        if (++size_ == kEnd) {
+          toRuns();
+        }
+        return true;
+      }
+      case Kind::kRun:
+        break;
+    }
+    std::size_t i = runAtOrAfter(low);
+    if (i < runs_.size() && runs_[i].first <= low) {
+      return false;
+    }
+    bool joinsPrevious = i > 0 && runs_[i - 1].last + 1u == low;
+    bool joinsNext = i < runs_.size() && runs_[i].first == low + 1;
+    if (joinsPrevious && joinsNext) {
+      runs_[i - 1].last = runs_[i].last;
+      runs_.erase(runs_.begin() + i);
+    }
+    else if (joinsPrevious) {
+      runs_[i - 1].last = static_cast<std::uint16_t>(low);
+    }
+    else if (joinsNext) {
+      runs_[i].first = static_cast<std::uint16_t>(low);
+    }
+    else {
+      runs_.insert(runs_.begin() + i, {static_cast<std::uint16_t>(low), static_cast<std::uint16_t>(low)});
+    }
+    size_++;
+    fitRuns();
+    return true;
+  }
+
+  // return whether low was erased.  A bitmap only turns back into an array
+  // at half of kArrayMax, so that keys going in and out at the limit do not
+  // convert the container every time.
+  bool erase(std::uint32_t low) {
+    switch (kind_) {
+      case Kind::kArray: {
+        auto it = std::lower_bound(values_.begin(), values_.end(), low);
+        if (it == values_.end() || *it != low) {
+          return false;
+        }
+        values_.erase(it);
+        size_--;
+        return true;
+      }
+      case Kind::kBitmap: {
+        std::uint64_t& word = bits_[low / 64];
+        if (!(word & bitOf(low))) {
+          return false;
+        }
+        word &= ~bitOf(low);
+        if (--size_ <= kArrayMax / 2) {
+          toArray();
+        }
+        return true;
+      }
+      case Kind::kRun:
+        break;
+    }
+    std::size_t i = runAtOrAfter(low);
+    if (i == runs_.size() || runs_[i].first > low) {
+      return false;
+    }
+    Run& run = runs_[i];
+    if (run.first == run.last) {
+      runs_.erase(runs_.begin() + i);
+    }
+    else if (run.first == low) {
+      run.first++;
+    }
+    else if (run.last == low) {
+      run.last--;
+    }
+    else {
+      Run upper {static_cast<std::uint16_t>(low + 1), run.last};
+      run.last = static_cast<std::uint16_t>(low - 1);
+      runs_.insert(runs_.begin() + i + 1, upper);
+    }
+    size_--;
+    fitRuns();
+    return true;
+  }
+
+  // switch to whichever of the three forms takes the least room
+  void optimize() {
+    std::size_t runBytes = countRuns() * sizeof(Run);
+    std::size_t arrayBytes = size_ <= kArrayMax ? size_ * sizeof(std::uint16_t)
+                                                : std::numeric_limits<std::size_t>::max();
+    std::size_t bitmapBytes = kBitmapWords * sizeof(std::uint64_t);
+    if (runBytes < std::min(arrayBytes, bitmapBytes)) {
+      if (kind_ != Kind::kRun) {
+        toRuns();
+      }
+    }
+    else if (arrayBytes <= bitmapBytes) {
+      if (kind_ != Kind::kArray) {
+        toArray();
+      }
+    }
+    else if (kind_ != Kind::kBitmap) {
+      toBitmap();
+    }
+    values_.shrink_to_fit();
+    runs_.shrink_to_fit();
+  }
+};
+
+}  // namespace hashset_detail
+
+// A set of 32-bit integer keys for data that is mostly clustered, such as
+// runs of consecutive ids, in the layout of a roaring bitmap.  The keys are
+// split by their high 16 bits into chunks, kept in a sorted vector, and each
+// chunk stores its low 16 bits as a sorted array while it holds up to 4096
+// keys, as a 8 KiB bitmap beyond that, and as runs of consecutive values
+// once optimize() finds them smaller.  A dense chunk costs one bit per key
+// instead of a node, and a contiguous one a few bytes in all.
+//
+// The interface follows HashSet, except that iteration is in increasing key
+// order and that any insert or erase invalidates iterators, since it may
+// convert the container underneath them.
+template <typename Key = int>
+class RoaringSet {
+  static_assert(std::is_integral_v<Key> && sizeof(Key) == 4, "RoaringSet holds 32-bit integers");
+
+ private:
+  using Container = hashset_detail::RoaringContainer;
+
+  // signed keys have their sign bit flipped, so that chunks sort like keys
+  static constexpr std::uint32_t kFlip = std::is_signed_v<Key> ? 0x8000'0000u : 0;
+
+  // the high 16 bits of every chunk, sorted, and the chunks themselves
+  std::vector<std::uint16_t> highs;
+  std::vector<Container> chunks;
+  std::size_t size_;
+
+  static std::uint32_t bitsOf(Key key) {
+    return static_cast<std::uint32_t>(key) ^ kFlip;
+  }
+
+  static Key keyOf(std::uint32_t bits) {
+    return static_cast<Key>(bits ^ kFlip);
+  }
+
+  // the first chunk whose high bits are at or above high
+  std::size_t chunkAtOrAfter(std::uint16_t high) const;
+
+ public:
+  using key_type = Key;
+  using value_type = Key;
+  using ContainerKind = Container::Kind;
+
+  class Iterator {
+   private:
+    const RoaringSet* set_;
+    std::size_t chunk_;
+    std::uint32_t low_;
+
+    // moves to the first key at or after (chunk_, low_)
+    void settle() {
+      while (chunk_ < set_->chunks.size()) {
+        low_ = low_ < Container::kEnd ? set_->chunks[chunk_].next(low_) : Container::kEnd;
+        if (low_ != Container::kEnd) {
+          return;
+        }
+        ++chunk_;
+        low_ = 0;
+      }
+      low_ = 0;
+    }
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = Key;
+
+    Iterator() : set_(nullptr), chunk_(0), low_(0) {}
+
+    Iterator(const RoaringSet* set, std::size_t chunk, std::uint32_t low)
+        : set_(set), chunk_(chunk), low_(low) {
+      settle();
+    }
+
+    Key operator*() const {
+      return keyOf((static_cast<std::uint32_t>(set_->highs[chunk_]) << 16) | low_);
+    }
+
+    Iterator& operator++() {
+      ++low_;
+      settle();
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return chunk_ == other.chunk_ && low_ == other.low_;
+    }
+  };
+
+  RoaringSet();
+
+  //*** Core Level 1 functionality
+
+  std::pair<Iterator, bool> insert(Key key);
+
+  bool contains(Key key) const;
+
+  void erase(Key key);
+
+  void clear();
+
+  //*** Core Level 2 functionality
+
+  Iterator find(Key key) const;
+
+  // return an iterator to the key after it
+  Iterator erase(Iterator it);
+
+  //*** Utility functions
+
+  std::size_t size() const;
+
+  bool empty() const;
+
+  // convert every chunk to the smallest of its three forms, which is the
+  // only way runs are made out of keys inserted one at a time
+  void optimize();
+
+  // the heap memory held by the set, in bytes
+  std::size_t memoryUsage() const;
+
+  // return how many chunks currently have the given form
+  std::size_t chunkCount(ContainerKind kind) const;
+
+  //*** Iterator Functionality
+
+  Iterator begin() const;
+
+  Iterator end() const;
+};
+
+
+template <typename Key>
+RoaringSet<Key>::RoaringSet() : size_(0) {}
+
+template <typename Key>
+std::size_t RoaringSet<Key>::chunkAtOrAfter(std::uint16_t high) const {
+  return std::lower_bound(highs.begin(), highs.end(), high) - highs.begin();
+}
+
+template <typename Key>
+auto RoaringSet<Key>::insert(Key key) -> std::pair<Iterator, bool> {
+  std::uint32_t bits = bitsOf(key);
+  auto high = static_cast<std::uint16_t>(bits >> 16);
+  std::uint32_t low = bits & 0xffff;
+  std::size_t c = chunkAtOrAfter(high);
+  if (c == highs.size() || highs[c] != high) {
+    highs.insert(highs.begin() + c, high);
+    chunks.insert(chunks.begin() + c, Container());
+  }
+  bool inserted = chunks[c].insert(low);
+  size_ += inserted;
+  return {Iterator(this, c, low), inserted};
+}
+
+template <typename Key>
+bool RoaringSet<Key>::contains(Key key) const {
+  std::uint32_t bits = bitsOf(key);
+  auto high = static_cast<std::uint16_t>(bits >> 16);
+  std::size_t c = chunkAtOrAfter(high);
+  return c < highs.size() && highs[c] == high && chunks[c].contains(bits & 0xffff);
+}
+
+// Chunks that become empty are dropped.
+template <typename Key>
+void RoaringSet<Key>::erase(Key key) {
+  std::uint32_t bits = bitsOf(key);
+  auto high = static_cast<std::uint16_t>(bits >> 16);
+  std::size_t c = chunkAtOrAfter(high);
+  if (c == highs.size() || highs[c] != high || !chunks[c].erase(bits & 0xffff)) {
+    return;
+  }
+  size_--;
+  if (chunks[c].size() == 0) {
+    highs.erase(highs.begin() + c);
+    chunks.erase(chunks.begin() + c);
+  }
+}
+
+template <typename Key>
+void RoaringSet<Key>::clear() {
+  highs.clear();
+  chunks.clear();
+  size_ = 0;
+}
+
+template <typename Key>
+auto RoaringSet<Key>::find(Key key) const -> Iterator {
+  if (!contains(key)) {
+    return end();
+  }
+  std::uint32_t bits = bitsOf(key);
+  return Iterator(this, chunkAtOrAfter(static_cast<std::uint16_t>(bits >> 16)), bits & 0xffff);
+}
+
+template <typename Key>
+auto RoaringSet<Key>::erase(Iterator it) -> Iterator {
+  Key key = *it;
+  ++it;
+  if (it == end()) {
+    erase(key);
+    return end();
+  }
+  Key following = *it;
+  erase(key);
+  return find(following);
+}
+
+template <typename Key>
+std::size_t RoaringSet<Key>::size() const {
+  return size_;
+}
+
+template <typename Key>
+bool RoaringSet<Key>::empty() const {
+  return size_ == 0;
+}
+
+template <typename Key>
+void RoaringSet<Key>::optimize() {
+  for (Container& chunk : chunks) {
+    chunk.optimize();
+  }
+  highs.shrink_to_fit();
+  chunks.shrink_to_fit();
+}
+
+template <typename Key>
+std::size_t RoaringSet<Key>::memoryUsage() const {
+  std::size_t bytes = highs.capacity() * sizeof(std::uint16_t) + chunks.capacity() * sizeof(Container);
+  for (const Container& chunk : chunks) {
+    bytes += chunk.bytes();
+  }
+  return bytes;
+}
+
+template <typename Key>
+std::size_t RoaringSet<Key>::chunkCount(ContainerKind kind) const {
+  return std::count_if(chunks.begin(), chunks.end(),
+                       [kind](const Container& chunk) { return chunk.kind() == kind; });
+}
+
+template <typename Key>
+auto RoaringSet<Key>::begin() const -> Iterator {
+  return Iterator(this, 0, 0);
+}
+
+template <typename Key>
+auto RoaringSet<Key>::end() const -> Iterator {
+  return Iterator(this, chunks.size(), 0);
+}
+
+#endif      // ROARING_SET_HPP_
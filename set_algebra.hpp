@@ -0,0 +1,208 @@
+#ifndef SET_ALGEBRA_HPP_
+#define SET_ALGEBRA_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "hash.hpp"
+
+// Union, intersection, difference and symmetric difference of two sets of the
+// same type, out of place (returning a new set) and in place (changing the
+// first one).  Work is done from the smaller side wherever the result allows
+// it.  The side that is scanned is split into bucket ranges with
+// forEachInPart, and each range is probed against the other set on its own
+// thread.  The sets themselves are never written from more than one thread:
+// the keys found are gathered per range and then inserted or erased in one
+// go, into a set reserved for its final size.
+//
+// threads = 0 uses every hardware thread; small inputs run on the caller's
+// thread alone.  Neither set may be modified by anyone else meanwhile.
+
+namespace hashset_detail {
+
+// below this many keys scanned per thread, starting threads costs more than
+// it saves
+inline constexpr std::size_t kMinKeysPerThread = 1 << 14;
+
+inline std::size_t algebraThreads(std::size_t threads, std::size_t keys) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return std::clamp<std::size_t>(keys / kMinKeysPerThread, 1, threads);
+}
+
+// Calls visit(part, key) for every key of scanned, the parts spread over as
+// many threads.
+template <typename Set, typename Visit>
+void visitParts(const Set& scanned, std::size_t parts, Visit visit) {
+  auto work = [&](std::size_t part) {
+    scanned.forEachInPart(part, parts, [&](const auto& key) { visit(part, key); });
+  };
+
+  std::vector<std::thread> workers;
+  for (std::size_t part = 1; part < parts; ++part) {
+    workers.emplace_back(work, part);
+  }
+  work(0);
+  for (std::thread& w : workers) {
+    w.join();
+  }
+}
+
+// The keys of scanned for which keep(key) holds, gathered in parallel.  One
+// vector per part, in bucket order.
+template <typename Set, typename Keep>
+std::vector<std::vector<typename Set::key_type>> gather(const Set& scanned, std::size_t threads,
+                                                        Keep keep) {
+  std::size_t parts = algebraThreads(threads, scanned.size());
+  std::vector<std::vector<typename Set::key_type>> found(parts);
+  visitParts(scanned, parts, [&](std::size_t part, const auto& key) {
+    if (keep(key)) {
+      found[part].push_back(key);
+    }
+  });
+  return found;
+}
+
+template <typename Key>
+std::size_t totalSize(const std::vector<std::vector<Key>>& found) {
+  std::size_t n = 0;
+  for (const auto& keys : found) {
+    n += keys.size();
+  }
+  return n;
+}
+
+// an empty set with the hasher, key comparison and, as a copy would get it,
+// the allocator of model
+template <typename Set>
+Set emptyLike(const Set& model) {
+  using Allocator = typename Set::allocator_type;
+  return Set(model.hash_function(), model.key_eq(),
+             std::allocator_traits<Allocator>::select_on_container_copy_construction(
+                 model.get_allocator()));
+}
+
+template <typename Set, typename Key>
+void insertAll(Set& set, const std::vector<std::vector<Key>>& found) {
+  set.reserve(set.size() + totalSize(found));
+  for (const auto& keys : found) {
+    for (const Key& key : keys) {
+      set.insert(key);
+    }
+  }
+}
+
+template <typename Set, typename Key>
+void eraseAll(Set& set, const std::vector<std::vector<Key>>& found) {
+  for (const auto& keys : found) {
+    for (const Key& key : keys) {
+      set.erase(key);
+    }
+  }
+}
+
+}  // namespace hashset_detail
+
+//*** Out of place
+
+// keys in a or b: a copy of the larger set plus what only the smaller adds
+template <typename Set>
+Set setUnion(const Set& a, const Set& b, std::size_t threads = 0) {
+  const Set& large = (a.size() >= b.size()) ? a : b;
+  const Set& small = (a.size() >= b.size()) ? b : a;
+  auto extra = hashset_detail::gather(small, threads,
+                                      [&large](const auto& key) { return !large.contains(key); });
+  Set result(large);
+  hashset_detail::insertAll(result, extra);
+  return result;
+}
+
+// keys in both: the smaller set is scanned and probed against the larger
+template <typename Set>
+Set setIntersection(const Set& a, const Set& b, std::size_t threads = 0) {
+  const Set& large = (a.size() >= b.size()) ? a : b;
+  const Set& small = (a.size() >= b.size()) ? b : a;
+  auto common = hashset_detail::gather(small, threads,
+                                       [&large](const auto& key) { return large.contains(key); });
+  Set result = hashset_detail::emptyLike(a);
+  hashset_detail::insertAll(result, common);
+  return result;
+}
+
+// keys in a but not in b.  When b is the smaller set, a is copied and the
+// keys of b found in it are erased, so only b is scanned.
+template <typename Set>
+Set setDifference(const Set& a, const Set& b, std::size_t threads = 0) {
+  if (b.size() < a.size()) {
+    auto common = hashset_detail::gather(b, threads, [&a](const auto& key) { return a.contains(key); });
+    Set result(a);
+    hashset_detail::eraseAll(result, common);
+    return result;
+  }
+  auto only = hashset_detail::gather(a, threads, [&b](const auto& key) { return !b.contains(key); });
+  Set result = hashset_detail::emptyLike(a);
+  hashset_detail::insertAll(result, only);
+  return result;
+}
+
+// keys in exactly one of a and b; both sides have to be scanned
+template <typename Set>
+Set setSymmetricDifference(const Set& a, const Set& b, std::size_t threads = 0) {
+  auto onlyA = hashset_detail::gather(a, threads, [&b](const auto& key) { return !b.contains(key); });
+  auto onlyB = hashset_detail::gather(b, threads, [&a](const auto& key) { return !a.contains(key); });
+  Set result = hashset_detail::emptyLike(a);
+  result.reserve(hashset_detail::totalSize(onlyA) + hashset_detail::totalSize(onlyB));
+  hashset_detail::insertAll(result, onlyA);
+  hashset_detail::insertAll(result, onlyB);
+  return result;
+}
+
+//*** In place
+
+// a = a | b
+template <typename Set>
+void unionWith(Set& a, const Set& b, std::size_t threads = 0) {
+  auto extra = hashset_detail::gather(b, threads, [&a](const auto& key) { return !a.contains(key); });
+  hashset_detail::insertAll(a, extra);
+}
+
+// a = a & b.  When a is the larger set most of it goes, and building the
+// result from the smaller side is cheaper than erasing key by key.
+template <typename Set>
+void intersectWith(Set& a, const Set& b, std::size_t threads = 0) {
+  if (b.size() < a.size()) {
+    a = setIntersection(a, b, threads);
+    return;
+  }
+  auto gone = hashset_detail::gather(a, threads, [&b](const auto& key) { return !b.contains(key); });
+  hashset_detail::eraseAll(a, gone);
+}
+
+// a = a - b, scanning whichever side is smaller
+template <typename Set>
+void subtract(Set& a, const Set& b, std::size_t threads = 0) {
+  const Set& small = (b.size() < a.size()) ? b : a;
+  const Set& other = (b.size() < a.size()) ? a : b;
+  auto gone = hashset_detail::gather(small, threads,
+                                     [&other](const auto& key) { return other.contains(key); });
+  hashset_detail::eraseAll(a, gone);
+}
+
+// a = a ^ b: the keys of b already in a leave, the others join
+template <typename Set>
+void symmetricDifferenceWith(Set& a, const Set& b, std::size_t threads = 0) {
+  using Key = typename Set::key_type;
+  std::size_t parts = hashset_detail::algebraThreads(threads, b.size());
+  std::vector<std::vector<Key>> common(parts);
+  std::vector<std::vector<Key>> extra(parts);
+  hashset_detail::visitParts(b, parts, [&](std::size_t part, const Key& key) {
+    (a.contains(key) ? common : extra)[part].push_back(key);
+  });
+  hashset_detail::eraseAll(a, common);
+  hashset_detail::insertAll(a, extra);
+}
+
+#endif      // SET_ALGEBRA_HPP_
@@ -0,0 +1,261 @@
+#ifndef SMALL_HASH_HPP_
+#define SMALL_HASH_HPP_
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "hash.hpp"
+
+// A set that keeps its first N keys inside the object and only builds a Set
+// once it grows past them.  Up to N keys, lookups are a scan of the inline
+// array and nothing touches the heap, so a short-lived set that stays small
+// costs no allocation at all to construct, fill and destroy.
+//
+// Once it has spilled into a Set the keys stay there, even when erasing
+// brings the size back down, until clear() returns the set to inline
+// storage.  Inline keys are compared with the Set's key_equal.  Iterators
+// are invalidated by inserts and erases of other keys while the keys are
+// inline, and when the set spills.
+template <typename Set = HashSet, std::size_t N = 8>
+class SmallHashSet {
+ public:
+  using key_type = typename Set::key_type;
+  using value_type = typename Set::value_type;
+  using hasher = typename Set::hasher;
+  using key_equal = typename Set::key_equal;
+  using Key = key_type;
+
+  static_assert(N > 0, "SmallHashSet needs room for at least one inline key");
+  static_assert(std::is_default_constructible_v<Key>, "inline keys are default constructed");
+
+ private:
+  // integers compared with == are scanned without an early exit, so that the
+  // compiler can compare all N slots at once with vector instructions
+  static constexpr bool kWideScan =
+      std::is_integral_v<Key> && (std::is_same_v<key_equal, std::equal_to<Key>> ||
+                                  std::is_same_v<key_equal, std::equal_to<>>);
+
+  std::array<Key, N> keys_;
+  // inline keys in use; 0 once the set has spilled
+  std::size_t count_;
+  std::unique_ptr<Set> set_;
+  [[no_unique_address]] hasher hash_;
+  [[no_unique_address]] key_equal equal_;
+
+  // the inline slot holding key, or count_
+  std::size_t slotOf(const Key& key) const {
+    if constexpr (kWideScan) {
+      std::size_t slot = count_;
+      for (std::size_t i = N; i-- > 0; ) {
+        slot = (i < count_ && keys_[i] == key) ? i : slot;
+      }
+      return slot;
+    }
+    else {
+      for (std::size_t i = 0; i < count_; ++i) {
+        if (equal_(keys_[i], key)) {
+          return i;
+        }
+      }
+      return count_;
+    }
+  }
+
+  // moves the inline keys into a newly built Set
+  void spill() {
+    set_ = std::make_unique<Set>(hash_, equal_);
+    set_->reserve(2 * N);
+    for (std::size_t i = 0; i < count_; ++i) {
+      set_->insert(std::move(keys_[i]));
+    }
+    count_ = 0;
+  }
+
+ public:
+  class Iterator {
+   private:
+    friend class SmallHashSet;
+
+    // a pointer into the inline keys, or the position in the Set
+    const Key* key_;
+    typename Set::Iterator it_;
+
+    explicit Iterator(const Key* key) : key_(key), it_() {}
+
+    explicit Iterator(typename Set::Iterator it) : key_(nullptr), it_(it) {}
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = const Key&;
+
+    Iterator() : key_(nullptr), it_() {}
+
+    const Key& operator*() const {
+      return key_ ? *key_ : *it_;
+    }
+
+    const Key* operator->() const {
+      return &**this;
+    }
+
+    Iterator& operator++() {
+      if (key_) {
+        ++key_;
+      }
+      else {
+        ++it_;
+      }
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return key_ == other.key_ && (key_ || it_ == other.it_);
+    }
+  };
+
+  explicit SmallHashSet(const hasher& hash = hasher(), const key_equal& equal = key_equal())
+      : keys_(), count_(0), hash_(hash), equal_(equal) {}
+
+  SmallHashSet(const SmallHashSet& other)
+      : keys_(other.keys_), count_(other.count_),
+        set_(other.set_ ? std::make_unique<Set>(*other.set_) : nullptr), hash_(other.hash_),
+        equal_(other.equal_) {}
+
+  SmallHashSet(SmallHashSet&&) = default;
+
+  SmallHashSet& operator=(SmallHashSet other) {
+    std::swap(keys_, other.keys_);
+    std::swap(count_, other.count_);
+    std::swap(set_, other.set_);
+    std::swap(hash_, other.hash_);
+    std::swap(equal_, other.equal_);
+    return *this;
+  }
+
+  // return whether the keys have moved out of the object into a Set
+  bool spilled() const {
+    return set_ != nullptr;
+  }
+
+  //*** Core Level 1 functionality
+
+  std::pair<Iterator, bool> insert(const Key& key) {
+    return insertKey(key);
+  }
+
+  std::pair<Iterator, bool> insert(Key&& key) {
+    return insertKey(std::move(key));
+  }
+
+  bool contains(const Key& key) const {
+    return set_ ? set_->contains(key) : slotOf(key) != count_;
+  }
+
+  void erase(const Key& key) {
+    if (set_) {
+      set_->erase(key);
+      return;
+    }
+    std::size_t slot = slotOf(key);
+    if (slot != count_ && slot != --count_) {
+      keys_[slot] = std::move(keys_[count_]);
+    }
+  }
+
+  // spills right away if n keys would not fit inline
+  void reserve(std::size_t n) {
+    if (!set_ && n > N) {
+      spill();
+    }
+    if (set_) {
+      set_->reserve(n);
+    }
+  }
+
+  // frees the Set, if there is one, and goes back to inline storage
+  void clear() {
+    set_.reset();
+    count_ = 0;
+  }
+
+  //*** Core Level 2 functionality
+
+  Iterator find(const Key& key) {
+    if (set_) {
+      return Iterator(set_->find(key));
+    }
+    std::size_t slot = slotOf(key);
+    return slot == count_ ? end() : Iterator(&keys_[slot]);
+  }
+
+  // The last inline key moves into the erased slot, so the iterator returned
+  // points at it and iteration still visits every key once.
+  Iterator erase(Iterator it) {
+    if (set_) {
+      return Iterator(set_->erase(it.it_));
+    }
+    std::size_t slot = it.key_ - keys_.data();
+    if (slot != --count_) {
+      keys_[slot] = std::move(keys_[count_]);
+    }
+    return Iterator(&keys_[slot]);
+  }
+
+  //*** Utility functions
+
+  std::size_t size() const {
+    return set_ ? set_->size() : count_;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  //*** Iterator Functionality
+
+  Iterator begin() {
+    return set_ ? Iterator(set_->begin()) : Iterator(keys_.data());
+  }
+
+  Iterator end() {
+    return set_ ? Iterator(set_->end()) : Iterator(keys_.data() + count_);
+  }
+
+ private:
+  template <typename K>
+  std::pair<Iterator, bool> insertKey(K&& key);
+};
+
+
+template <typename Set, std::size_t N>
+template <typename K>
+auto SmallHashSet<Set, N>::insertKey(K&& key) -> std::pair<Iterator, bool> {
+  if (!set_) {
+    std::size_t slot = slotOf(key);
+    if (slot != count_) {
+      return {Iterator(&keys_[slot]), false};
+    }
+    if (count_ < N) {
+      keys_[count_] = std::forward<K>(key);
+      return {Iterator(&keys_[count_++]), true};
+    }
+    spill();
+  }
+  auto [it, inserted] = set_->insert(std::forward<K>(key));
+  return {Iterator(it), inserted};
+}
+
+#endif      // SMALL_HASH_HPP_